@@ -0,0 +1,82 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ACCESS_LOG_MAGIC            "HTTPACL1"
+#define ACCESS_LOG_VERSION          2   /* 2: target keeps its leading '/' */
+#define ACCESS_LOG_DEFAULT_RECORDS  (1u << 20)  /* 192 MiB of records, then the oldest are overwritten */
+#define ACCESS_TARGET_MAX           104
+
+/* The access log is a file of fixed-size little-endian records behind a
+   header, mapped shared and used as a ring: record i lives in slot
+   i % capacity. Writers claim an index with one atomic add and copy the
+   record in; nothing is formatted or written out on the request path. A
+   reader maps the same file (tools/access_log_dump.c) and takes the last
+   `capacity` records up to header.next, skipping any whose seq is not
+   its index + 1 (still being written, or already overwritten). */
+
+typedef struct access_log_header_s
+{
+    char     magic[8];              /* ACCESS_LOG_MAGIC */
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;              /* slots */
+    uint64_t next;                  /* records ever claimed */
+    char     pad[32];
+} access_log_header_t;
+
+/* One answered request. The *_ns phase stamps are CLOCK_MONOTONIC; 0
+   means the phase was not reached (e.g. no validation after a 400). */
+typedef struct access_record_s
+{
+    uint64_t seq;                   /* index + 1, stored last */
+    uint64_t wall_ns;               /* CLOCK_REALTIME when the record was made */
+    uint64_t accept_ns;             /* connection accepted */
+    uint64_t first_byte_ns;         /* first byte of this request read */
+    uint64_t dispatched_ns;         /* handed to the worker pool */
+    uint64_t started_ns;            /* a worker took it up */
+    uint64_t parsed_ns;             /* request fields extracted */
+    uint64_t validated_ns;          /* routed and checked */
+    uint64_t last_byte_ns;          /* response sent */
+    uint64_t bytes_sent;            /* head and body */
+    int32_t  resource_id;           /* index in resources.conf, -1 if none */
+    uint16_t status;
+    uint8_t  method;                /* http_methods_code, METHOD_COUNT if unknown */
+    uint8_t  keep_alive;
+    char     target[ACCESS_TARGET_MAX];     /* path with its '/', no query; truncated, '\0'-padded */
+} access_record_t;
+
+_Static_assert(sizeof(access_log_header_t) == 64, "access log header layout");
+_Static_assert(sizeof(access_record_t) == 192, "access log record layout");
+
+/**
+*   @brief  Map (creating or resizing) the access log at `path` with room
+*           for `capacity` records. An existing log of the same capacity
+*           is continued, anything else is started afresh. Call once before
+*           the workers start.
+*
+*   @return 0 on success, -1 on failure (access logging stays off).
+*/
+int  access_log_open(const char *path, uint64_t capacity);
+
+/**
+*   @brief  Whether access_log_open() succeeded; callers skip taking
+*           timestamps otherwise.
+*/
+int  access_log_enabled(void);
+
+/**
+*   @brief  Append a record; its seq is filled in here. Safe from any
+*           number of threads.
+*/
+void access_log_write(access_record_t *record);
+
+/**
+*   @brief  Store a request target in the record as the client sent it:
+*           `target` is the parser's slice, which starts after the '/'.
+*/
+void access_record_set_target(access_record_t *record, const char *target, size_t length);
+
+#endif // ACCESS_LOG_H
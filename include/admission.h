@@ -0,0 +1,90 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADMISSION_DEFAULT_TARGET_MS     10      /* queue delay we are willing to carry */
+#define ADMISSION_DEFAULT_INTERVAL_MS   100     /* how long it may stay above before shedding */
+#define ADMISSION_DEFAULT_RETRY_AFTER   1       /* seconds, sent with each 503 */
+
+#define ADMISSION_REPLY_SIZE            192
+
+/* CoDel applied at the door. Workers report how long each dispatched
+   connection waited in the pool's queue; once that delay has stayed above
+   `target` for a whole `interval`, the reactor turns away dispatches at a
+   rate that grows with the square root of the shed count until the delay
+   drops back under target. One per reactor: only its thread admits. */
+typedef struct admission_s
+{
+    uint64_t target_ns;             /* 0 = only shed when the queue is full */
+    uint64_t interval_ns;
+
+    /* Written by the workers. */
+    uint64_t first_above_ns;        /* when the delay may first count as standing; 0 = below target */
+    uint32_t overloaded;            /* delay above target for an interval */
+
+    /* Reactor only. */
+    uint32_t shedding;
+    uint32_t shed_count;            /* sheds in the current episode */
+    uint64_t shed_next_ns;
+
+    /* Counters, read with admission_get_stats(). */
+    uint64_t shed_delay;            /* turned away by the controller */
+    uint64_t shed_full;             /* turned away because the queue was full */
+    uint64_t delay_sum_ns;
+    uint64_t delay_count;
+    uint64_t delay_max_ns;
+
+    char     reply[ADMISSION_REPLY_SIZE];   /* the 503, formatted once */
+    size_t   reply_len;
+} admission_t;
+
+typedef struct admission_stats_s
+{
+    uint64_t shed_delay;
+    uint64_t shed_full;
+    uint64_t delay_sum_ns;          /* queue delay of every dispatch that reached a worker */
+    uint64_t delay_count;
+    uint64_t delay_max_ns;
+    int      shedding;              /* delay currently above target */
+} admission_stats_t;
+
+/**
+*   @brief  Set the thresholds and format the 503 reply. A `target_ms` of 0
+*           disables the controller; full queues are still answered with
+*           the 503.
+*/
+void admission_init(admission_t *adm, unsigned target_ms, unsigned interval_ms, unsigned retry_after);
+
+/**
+*   @brief  Monotonic clock in nanoseconds, the time base of this module.
+*/
+uint64_t admission_now(void);
+
+/**
+*   @brief  Decide on one dispatch. Reactor thread only.
+*
+*   @return 1 to queue it, 0 to shed it with admission_reject().
+*/
+int  admission_admit(admission_t *adm, uint64_t now_ns);
+
+/**
+*   @brief  Report that a dispatch queued at `queued_ns` reached a worker.
+*           Safe from any number of workers.
+*/
+void admission_dequeued(admission_t *adm, uint64_t queued_ns);
+
+/**
+*   @brief  Answer `fd` with the precomputed 503 without blocking. The
+*           caller closes it afterwards. `full` says the pool refused the
+*           fd, rather than the controller.
+*/
+void admission_reject(admission_t *adm, int fd, int full);
+
+/**
+*   @brief  Snapshot of the counters.
+*/
+void admission_get_stats(admission_t *adm, admission_stats_t *stats);
+
+#endif // ADMISSION_H
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE    4096    /* default block, one buffer-pool slab */
+#define ARENA_ALIGN         16
+
+typedef struct arena_block_s
+{
+    struct arena_block_s *next;
+    size_t                size;     /* bytes in the block, header included */
+    size_t                used;     /* bytes handed out after the header */
+} arena_block_t;
+
+/* Bump allocator. Blocks come from the buffer pool; the first one survives
+   arena_reset() so a keep-alive connection allocates nothing after its
+   first request. Zero-initialise before use. */
+typedef struct arena_s
+{
+    arena_block_t *blocks;          /* newest first; the oldest is kept */
+} arena_t;
+
+/**
+*   @brief  Allocate `size` bytes aligned to ARENA_ALIGN. Never freed
+*           individually: memory is reclaimed by arena_reset().
+*
+*   @return The memory, or NULL if no block could be obtained.
+*/
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+*   @brief  Copy `length` bytes of src into the arena and '\0'-terminate them.
+*/
+char *arena_strndup(arena_t *arena, const char *src, size_t length);
+
+/**
+*   @brief  Drop every allocation at once. Keeps the first block for the
+*           next request and gives the others back to the pool.
+*/
+void  arena_reset(arena_t *arena);
+
+/**
+*   @brief  Give every block back, leaving the arena empty and reusable.
+*/
+void  arena_free(arena_t *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,61 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUF_POOL_MIN_SHIFT      12                  /* smallest class: 4 KB */
+#define BUF_POOL_MAX_SHIFT      20                  /* largest class:  1 MB */
+#define BUF_POOL_CLASSES        (BUF_POOL_MAX_SHIFT - BUF_POOL_MIN_SHIFT + 1)
+#define BUF_POOL_MAX_SIZE       ((size_t)1 << BUF_POOL_MAX_SHIFT)
+
+#define BUF_POOL_CACHE_BYTES    (1u << 20)          /* per thread, per class */
+#define BUF_POOL_DEPOT_BYTES    (16u << 20)         /* shared, per class */
+
+typedef struct buffer_pool_stats_s
+{
+    uint64_t hits;          /* served from a thread cache or the depot */
+    uint64_t misses;        /* had to malloc() */
+    uint64_t released;      /* returned to the allocator (caches full or trimmed) */
+    size_t   depot_bytes;   /* bytes currently parked in the shared depot */
+} buffer_pool_stats_t;
+
+/**
+*   @brief  Take a buffer of at least `size` bytes (rounded up to a power-of-two
+*           class between 4 KB and 1 MB). Served from the calling thread's
+*           free list, then from the shared depot, then from malloc().
+*
+*   @param[in]  size        minimum size in bytes
+*   @param[out] class_size  actual size of the returned buffer
+*
+*   @return The buffer, or NULL if `size` exceeds BUF_POOL_MAX_SIZE or memory
+*           is exhausted.
+*/
+char *buffer_pool_acquire(size_t size, size_t *class_size);
+
+/**
+*   @brief  Give a buffer back. `class_size` must be the value returned by
+*           buffer_pool_acquire(). The buffer goes to the calling thread's free
+*           list, to the depot when that list is full, or back to the
+*           allocator when both are.
+*/
+void  buffer_pool_release(char *buf, size_t class_size);
+
+/**
+*   @brief  Move the first `used` bytes into a buffer of the next class and
+*           release the old one.
+*
+*   @return The new buffer (with *class_size updated), or NULL on failure, in
+*           which case the old buffer is left untouched.
+*/
+char *buffer_pool_grow(char *buf, size_t used, size_t *class_size);
+
+/**
+*   @brief  Return every buffer parked in the depot to the allocator. Called
+*           automatically when malloc() fails.
+*/
+void  buffer_pool_trim(void);
+
+void  buffer_pool_get_stats(buffer_pool_stats_t *stats);
+
+#endif // BUFFER_POOL_H
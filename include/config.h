@@ -5,7 +5,7 @@
 #define RESOURCES_CONF  "resources.conf"
 #define CONFIG_CONF     "config.conf"
 
-#define N_CONNECTIONS   10      /* Number of concurrent connections to be supported */
+#define N_CONNECTIONS   10000   /* Number of concurrent connections to be supported */
 
 #include <stdio.h>
 
@@ -15,9 +15,20 @@ typedef enum {
     LOG_DEBUG = 2
 } log_level_t;
 
+typedef enum {
+    IO_BACKEND_EPOLL = 0,   /* epoll reactor, plain send()/sendfile() */
+    IO_BACKEND_URING = 1    /* io_uring accept/recv, linked send + splice */
+} io_backend_t;
+
 extern log_level_t  g_log_level;
 extern FILE        *g_log_file;
+extern io_backend_t g_io_backend;
+
+void log_emit(log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
-void log_write(log_level_t level, const char *fmt, ...);
+/* Compares the level first: a disabled message costs one load, without
+   evaluating its arguments. See log.h. */
+#define log_write(level, ...) \
+    do { if ((level) <= g_log_level) log_emit((level), __VA_ARGS__); } while (0)
 
 #endif // CONFIG_H
\ No newline at end of file
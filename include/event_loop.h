@@ -0,0 +1,106 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "admission.h"
+#include "arena.h"
+#include "buffer_pool.h"
+#include "config.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+#define EVENT_BATCH     256     /* epoll events drained per epoll_wait() */
+
+#define CONN_BUFFER_INITIAL 4096            /* first slab for a new request */
+#define CONN_BUFFER_MAX     BUF_POOL_MAX_SIZE   /* largest request buffered whole */
+#define CONN_STREAM_BODY    (64u << 10)         /* larger bodies are dispatched with the head and streamed */
+
+struct event_loop_s;
+
+/* One accepted client. Owned by exactly one thread at a time: the reactor
+   while the fd is armed in epoll, a worker once the request was handed off. */
+typedef struct connection_s
+{
+    int                  fd;
+    char                *buf;          /* receive buffer, pooled; NULL while idle */
+    size_t               len;          /* bytes currently buffered */
+    size_t               cap;          /* usable size of buf */
+    http_parser_t        parser;       /* resumable, fed as bytes arrive */
+    arena_t              arena;        /* per-request memory, reset after each */
+    int                  peer_closed;  /* recv() returned 0: answer, then close */
+    uint64_t             queued_ns;    /* when it was last handed to the pool */
+    uint64_t             accept_ns;    /* when it was accepted; 0 if requests are not timed
+                                          (no access log or metrics) */
+    uint64_t             first_byte_ns;/* first byte of the current request; 0 = none yet */
+    struct event_loop_s *loop;
+    struct connection_s *next;         /* io_uring re-arm list */
+} connection_t;
+
+typedef struct event_loop_s
+{
+    io_backend_t             backend;
+    int                      epoll_fd;
+    int                      listen_fd;
+    thread_pool_t           *pool;
+    admission_t              admission;    /* sheds dispatches while the pool lags */
+
+    /* io_uring backend: only the reactor submits to the ring, so workers
+       queue connections to re-arm on rearm_list and poke wake_fd. */
+    struct uring_s          *ring;
+    struct uring_buf_ring_s *bufs;
+    int                      wake_fd;
+    uint64_t                 wake_buf;
+    pthread_mutex_t          rearm_lock;
+    connection_t            *rearm_list;
+} event_loop_t;
+
+/**
+*   @brief  Set up the reactor for g_io_backend: an epoll instance with
+*           `listen_fd` switched to non-blocking, or an io_uring with a
+*           multishot accept and a provided buffer ring for recv. Every read
+*           is fed to the connection's parser; once it reports a complete (or
+*           malformed, or oversized) request the connection is handed to
+*           `pool` by fd and the worker fetches it with event_loop_conn().
+*           Dispatches loop->admission turns away, or the pool has no room
+*           for, are answered with its 503 and closed; the caller sets it up
+*           with admission_init() before running the loop.
+*
+*   @return 0 on success, -1 on failure.
+*/
+int  event_loop_init(event_loop_t *loop, int listen_fd, thread_pool_t *pool);
+
+/**
+*   @brief  Run the reactor forever on the calling thread: accept new clients,
+*           read available bytes and dispatch complete requests.
+*/
+void event_loop_run(event_loop_t *loop);
+
+/**
+*   @brief  Connection registered for `fd`, or NULL if none. Called once by
+*           the worker a dispatched fd was handed to, which also reports
+*           the time it spent queued to the loop's admission controller.
+*/
+connection_t *event_loop_conn(int fd);
+
+/**
+*   @brief  Give a connection back to the reactor after a worker answered its
+*           requests. Call this instead of touching the fd once the responses
+*           are sent and the connection is kept alive. conn->buf may still
+*           hold the start of the next request (conn->len bytes), already fed
+*           to conn->parser, which the caller must have reset in between.
+*/
+void event_loop_rearm(connection_t *conn);
+
+/**
+*   @brief  Unregister, close and free a connection.
+*/
+void event_loop_close(connection_t *conn);
+
+/**
+*   @brief  Connections open across every event loop.
+*/
+size_t event_loop_connections(void);
+
+#endif // EVENT_LOOP_H
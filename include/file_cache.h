@@ -0,0 +1,135 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILE_CACHE_DEFAULT_BYTES    (64u << 20)     /* total body + header bytes */
+#define FILE_CACHE_DEFAULT_ENTRIES  1024
+#define FILE_CACHE_DEFAULT_MAX_FILE (1u << 20)      /* larger files stream via sendfile */
+
+/* Which version of a file some bytes came from. */
+typedef struct file_ident_s
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t  mtime_ns;
+} file_ident_t;
+
+/* A cached response body and its head, formatted once for each Connection
+   value. Immutable once published; readers hold a reference, so eviction
+   or invalidation never frees an entry in use. */
+typedef struct file_cache_entry_s
+{
+    char                      *key;
+    const char                *body;
+    size_t                     body_len;
+    const char                *head[2];        /* [0] connection: close, [1] keep-alive */
+    size_t                     head_len[2];
+    file_ident_t               ident;          /* of the file the body came from */
+    size_t                     charge;         /* bytes counted against the budget */
+    uint32_t                   refs;           /* one for the table while linked */
+    uint32_t                   slot;           /* position on the CLOCK ring */
+    uint8_t                    referenced;     /* CLOCK bit */
+    struct file_cache_entry_s *hash_next;
+} file_cache_entry_t;
+
+/* Bounded map from a key to entries. Lookups share a read lock and only
+   touch atomics (refs, CLOCK bit, counters); inserts, evictions and
+   invalidations take it exclusively. */
+typedef struct file_cache_s
+{
+    pthread_rwlock_t     lock;
+    file_cache_entry_t **buckets;
+    unsigned int         bucket_count;
+    file_cache_entry_t **ring;          /* CLOCK order; NULL = free slot */
+    size_t               ring_size;     /* = max entries */
+    size_t               hand;
+    size_t               max_bytes;
+    size_t               max_file;
+    size_t               entries;
+    size_t               bytes;
+    uint64_t             hits;
+    uint64_t             misses;
+    uint64_t             inserts;
+    uint64_t             evictions;
+    uint64_t             invalidations;
+} file_cache_t;
+
+typedef struct file_cache_stats_s
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    uint64_t evictions;
+    uint64_t invalidations;
+    size_t   entries;
+    size_t   bytes;
+} file_cache_stats_t;
+
+/**
+*   @brief  Size a cache. `max_bytes` or `max_entries` of 0 leaves it
+*           disabled; bodies larger than `max_file` are never cached. Call
+*           once before the workers start.
+*/
+void file_cache_init(file_cache_t *cache, size_t max_bytes, size_t max_entries, size_t max_file);
+
+/**
+*   @brief  Whether a body of `size` bytes may be cached at all.
+*/
+int  file_cache_accepts(const file_cache_t *cache, size_t size);
+
+/**
+*   @brief  Look up `key`. On a hit the entry is returned with a reference
+*           the caller drops with file_cache_release().
+*
+*   @return The entry, or NULL on a miss.
+*/
+file_cache_entry_t *file_cache_get(file_cache_t *cache, const char *key);
+
+/**
+*   @brief  Read `body_len` bytes of `file_fd` (from offset 0) straight into
+*           a new entry and publish it, evicting others (CLOCK) to make
+*           room. Replaces an entry for the same key. An invalidation that
+*           ran between the caller's open() and this insert is lost; callers
+*           keying by path re-check for writers afterwards (see the resource
+*           generation in server.c).
+*
+*   @param[in]  head_close      response head with "connection: close"
+*   @param[in]  head_keep       response head with "connection: keep-alive"
+*
+*   @return The new entry with a reference for the caller, or NULL if it
+*           does not fit, the file came up short or memory ran out (the
+*           caller serves from disk).
+*/
+file_cache_entry_t *file_cache_insert(file_cache_t *cache, const char *key, const file_ident_t *ident,
+                                      int file_fd, size_t body_len,
+                                      const char *head_close, size_t head_close_len,
+                                      const char *head_keep,  size_t head_keep_len);
+
+/**
+*   @brief  As file_cache_insert(), copying the body from memory.
+*/
+file_cache_entry_t *file_cache_insert_mem(file_cache_t *cache, const char *key, const file_ident_t *ident,
+                                          const char *body, size_t body_len,
+                                          const char *head_close, size_t head_close_len,
+                                          const char *head_keep,  size_t head_keep_len);
+
+/**
+*   @brief  Drop a reference taken by file_cache_get() or an insert.
+*/
+void file_cache_release(file_cache_entry_t *entry);
+
+/**
+*   @brief  Forget `key`, e.g. after a POST rewrote the file.
+*/
+void file_cache_invalidate(file_cache_t *cache, const char *key);
+
+/**
+*   @brief  Snapshot of the counters.
+*/
+void file_cache_get_stats(file_cache_t *cache, file_cache_stats_t *stats);
+
+#endif // FILE_CACHE_H
@@ -0,0 +1,42 @@
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "http.h"
+
+#define GZIP_DEFAULT_LEVEL          6
+#define GZIP_DEFAULT_CACHE_BYTES    (16u << 20)
+#define GZIP_DEFAULT_CACHE_ENTRIES  1024
+#define GZIP_DEFAULT_MAX_FILE       (1u << 20)  /* larger files are compressed on the fly, uncached */
+#define GZIP_DEFAULT_STREAM_MAX     (64u << 20) /* larger still: only from a .gz sidecar */
+
+/**
+*   @brief  Whether responses of this type are worth compressing (text and
+*           WASM; images and fonts here are already compressed).
+*/
+int gzip_compressible(content_type_t type);
+
+/**
+*   @brief  Compress `length` bytes of src into a gzip member (RFC 1952).
+*
+*   @param[out] out         malloc()ed result, freed by the caller
+*   @param[out] out_length  its size
+*
+*   @return 0 on success, -1 on failure.
+*/
+int gzip_compress(const char *src, size_t length, int level, char **out, size_t *out_length);
+
+/* Receives compressed output as it is produced; nonzero aborts. */
+typedef int (*gzip_sink_t)(void *ctx, const char *data, size_t length);
+
+/**
+*   @brief  Compress the first `size` bytes of file_fd into a gzip member,
+*           handing the output to `sink` in pieces as it fills a fixed
+*           buffer, so memory use does not depend on the file size.
+*
+*   @return 0 on success, -1 if reading, compressing or the sink failed.
+*/
+int gzip_compress_file(int file_fd, uint64_t size, int level, gzip_sink_t sink, void *ctx);
+
+#endif // GZIP_H
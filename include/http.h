@@ -1,6 +1,8 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <stddef.h>
+#include <time.h>
 #include "utils.h"
 
 typedef enum {
@@ -17,6 +19,22 @@ typedef enum {
     MAX_EXTENSION
 }content_type_t;
 
+/* File extension -> content type, for resources.conf and directory files.
+   tools/gen_phash.c turns this list into a perfect hash table. */
+#define MIME_EXTENSIONS \
+    X("html", HTML)\
+    X("text", TEXT)\
+    X("txt",  TEXT)\
+    X("js",   JS)\
+    X("css",  CSS)\
+    X("json", JSON)\
+    X("png",  PNG)\
+    X("svg",  SVG)\
+    X("wasm", WASM)\
+    X("otf",  OTF)\
+    X("bin",  BIN)\
+    X("frag", BIN)
+
 extern const char *MimeType[MAX_EXTENSION];
 
 typedef enum{
@@ -127,6 +145,21 @@ extern const http_error_t http_errors[];
 
 const char *get_http_error_name(int code);
 
+/**
+*   @brief  Parse an HTTP-date: IMF-fixdate, or the obsolete RFC 850 and
+*           asctime forms recipients must still accept (RFC 9110 5.6.7).
+*
+*   @return 0 with the time in *out, -1 if the value is none of them.
+*/
+int http_date_parse(const char *value, size_t length, time_t *out);
+
+/**
+*   @brief  Format `t` as an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT").
+*
+*   @return 0, or -1 if `size` is too small.
+*/
+int http_date_format(char *buf, size_t size, time_t t);
+
 #define HTTP_METHODS \
     X(GET)\
     X(POST)\
@@ -146,4 +179,83 @@ typedef enum {
 
 extern const char * const http_methods_name[METHOD_COUNT];
 
+/* Header fields the parser recognises, with their lowercase names. Only a
+   few are acted on; the rest are indexed so http_request_header() finds
+   them without a scan. Adding one costs nothing per request: the lookup
+   is a perfect hash generated from this list by tools/gen_phash.c. */
+#define HTTP_HEADERS \
+    X(HDR_HOST,                      "host")\
+    X(HDR_CONNECTION,                "connection")\
+    X(HDR_CONTENT_LENGTH,            "content-length")\
+    X(HDR_USER_AGENT,                "user-agent")\
+    X(HDR_CONTENT_TYPE,              "content-type")\
+    X(HDR_ACCEPT,                    "accept")\
+    X(HDR_ORIGIN,                    "origin")\
+    X(HDR_REFERER,                   "referer")\
+    X(HDR_ACCEPT_ENCODING,           "accept-encoding")\
+    X(HDR_ACCEPT_LANGUAGE,           "accept-language")\
+    X(HDR_ACCEPT_CHARSET,            "accept-charset")\
+    X(HDR_AUTHORIZATION,             "authorization")\
+    X(HDR_CACHE_CONTROL,             "cache-control")\
+    X(HDR_COOKIE,                    "cookie")\
+    X(HDR_DATE,                      "date")\
+    X(HDR_DNT,                       "dnt")\
+    X(HDR_EXPECT,                    "expect")\
+    X(HDR_FORWARDED,                 "forwarded")\
+    X(HDR_IF_MATCH,                  "if-match")\
+    X(HDR_IF_MODIFIED_SINCE,         "if-modified-since")\
+    X(HDR_IF_NONE_MATCH,             "if-none-match")\
+    X(HDR_IF_RANGE,                  "if-range")\
+    X(HDR_IF_UNMODIFIED_SINCE,       "if-unmodified-since")\
+    X(HDR_KEEP_ALIVE,                "keep-alive")\
+    X(HDR_PRAGMA,                    "pragma")\
+    X(HDR_PRIORITY,                  "priority")\
+    X(HDR_RANGE,                     "range")\
+    X(HDR_SEC_CH_UA,                 "sec-ch-ua")\
+    X(HDR_SEC_CH_UA_MOBILE,          "sec-ch-ua-mobile")\
+    X(HDR_SEC_CH_UA_PLATFORM,        "sec-ch-ua-platform")\
+    X(HDR_SEC_FETCH_DEST,            "sec-fetch-dest")\
+    X(HDR_SEC_FETCH_MODE,            "sec-fetch-mode")\
+    X(HDR_SEC_FETCH_SITE,            "sec-fetch-site")\
+    X(HDR_SEC_FETCH_USER,            "sec-fetch-user")\
+    X(HDR_TE,                        "te")\
+    X(HDR_TRAILER,                   "trailer")\
+    X(HDR_TRANSFER_ENCODING,         "transfer-encoding")\
+    X(HDR_UPGRADE,                   "upgrade")\
+    X(HDR_UPGRADE_INSECURE_REQUESTS, "upgrade-insecure-requests")\
+    X(HDR_VIA,                       "via")\
+    X(HDR_X_FORWARDED_FOR,           "x-forwarded-for")\
+    X(HDR_X_FORWARDED_HOST,          "x-forwarded-host")\
+    X(HDR_X_FORWARDED_PROTO,         "x-forwarded-proto")\
+    X(HDR_X_REAL_IP,                 "x-real-ip")\
+    X(HDR_X_REQUESTED_WITH,          "x-requested-with")
+
+#define X(id, name) id,
+typedef enum
+{
+    HTTP_HEADERS
+    HDR_UNKNOWN
+}header_id;
+#undef X
+
+/* Lowercase field names, indexed by header_id. */
+extern const char *known_headers[HDR_UNKNOWN];
+
+/**
+*   @brief  Header id of a field name (any case), HDR_UNKNOWN if not listed.
+*/
+header_id http_header_lookup(const char *name, size_t length);
+
+/**
+*   @brief  http_methods_code of a method token (case-sensitive), or
+*           METHOD_COUNT.
+*/
+http_methods_code http_method_lookup(const char *name, size_t length);
+
+/**
+*   @brief  Content type for a file extension without the dot, or
+*           MAX_EXTENSION if not listed.
+*/
+content_type_t http_extension_lookup(const char *ext, size_t length);
+
 #endif
\ No newline at end of file
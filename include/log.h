@@ -0,0 +1,40 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define LOG_RING_SIZE   (64u << 10)     /* per thread; a message that does not fit is dropped */
+#define LOG_LINE_MAX    1024            /* longer messages are truncated */
+#define LOG_FLUSH_MS    50              /* flusher period when no ring fills up */
+
+/* log_write() formats on the calling thread into a ring of its own, with
+   no lock and no syscall; a flusher thread drains every ring to stdout and
+   g_log_file with one writev() per batch. Until log_start() runs, and if
+   it fails, messages are written synchronously instead. */
+
+typedef struct log_stats_s
+{
+    uint64_t written;       /* messages queued for the flusher */
+    uint64_t dropped;       /* messages lost to a full ring */
+} log_stats_t;
+
+/**
+*   @brief  Start the flusher thread. Call once g_log_file is known; the
+*           rings are also drained at exit().
+*
+*   @return 0 on success, -1 if logging stays synchronous.
+*/
+int  log_start(void);
+
+/**
+*   @brief  Write out everything queued so far.
+*/
+void log_flush(void);
+
+/**
+*   @brief  Snapshot of the counters.
+*/
+void log_get_stats(log_stats_t *stats);
+
+#endif // LOG_H
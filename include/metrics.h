@@ -0,0 +1,62 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_CACHE_LINE      64
+
+/* Request latency buckets, log-linear as in HDR histograms: each power of
+   two of microseconds is split into 2^METRICS_LAT_SUB_BITS equal steps. */
+#define METRICS_LAT_MIN_SHIFT   3       /* first bucket: up to 8 us */
+#define METRICS_LAT_SUB_BITS    1       /* 8, 12, 16, 24, 32, 48 ... us */
+#define METRICS_LAT_OCTAVES     22      /* last finite bound: 2^25 us, about 33 s */
+#define METRICS_LAT_BUCKETS     (1 + METRICS_LAT_OCTAVES * (1 << METRICS_LAT_SUB_BITS))
+
+struct event_loop_s;
+
+/* Counters for the /metrics resource (a resources.conf line whose type is
+   "metrics"), in the Prometheus text format. Each thread counts requests
+   into a block of its own, cache-line aligned so no two threads share a
+   line; nothing is shared or locked until a scrape sums the blocks. A
+   block outlives its thread and is taken over by the next new one, so the
+   totals survive workers the pool retires. */
+
+/**
+*   @brief  Size the per-thread blocks for the resource table. Counting is
+*           on only if one of the resources is the metrics endpoint. Call
+*           after load_resources(), before any request is served.
+*/
+void metrics_init(void);
+
+/**
+*   @brief  Whether metrics_init() found a metrics resource; callers skip
+*           taking timestamps otherwise.
+*/
+int  metrics_enabled(void);
+
+/**
+*   @brief  Report the pool, admission and connection figures of a reactor
+*           at scrape time. Call once per event loop before it runs.
+*
+*   @return 0 on success, -1 if out of memory.
+*/
+int  metrics_add_loop(struct event_loop_s *loop);
+
+/**
+*   @brief  Count one answered request. `resource_id` is -1 if it matched
+*           none, `method` METHOD_COUNT if unknown; `latency_ns` runs from
+*           its first byte read to its last byte sent.
+*/
+void metrics_record(int resource_id, unsigned method, unsigned status,
+                    uint64_t bytes_in, uint64_t bytes_out, uint64_t latency_ns);
+
+/**
+*   @brief  Render every counter in the Prometheus text exposition format.
+*
+*   @return The text (the caller frees it) with its length in *length, or
+*           NULL if out of memory.
+*/
+char *metrics_render(size_t *length);
+
+#endif // METRICS_H
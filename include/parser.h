@@ -0,0 +1,157 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "http.h"
+
+#define HTTP_MAX_HEADERS    64
+
+/* A view into the receive buffer: `len` bytes starting at buf + `off`. */
+typedef struct http_slice_s
+{
+    uint32_t off;
+    uint32_t len;
+} http_slice_t;
+
+typedef struct http_header_s
+{
+    http_slice_t name;              /* as sent, not case-folded */
+    http_slice_t value;             /* leading and trailing whitespace trimmed */
+    uint32_t     id;                /* header_id, HDR_UNKNOWN if not recognised */
+} http_header_t;
+
+typedef enum {
+    HTTP_PARSE_DONE = 0,            /* a whole request (head and body) is in */
+    HTTP_PARSE_NEED_MORE,           /* valid so far, feed more bytes */
+    HTTP_PARSE_ERROR                /* malformed; see parser->error */
+} http_parse_status;
+
+/* Resumable decoder for a chunked body (RFC 9112 7.1). Chunk extensions
+   and trailer fields are checked for framing and otherwise skipped. */
+typedef struct http_chunked_s
+{
+    uint64_t size;                  /* data bytes left in the current chunk */
+    uint64_t total;                 /* payload bytes decoded so far */
+    uint8_t  state;
+    uint8_t  digits;                /* hex digits of the chunk size read so far */
+} http_chunked_t;
+
+/* Result of http_request_parse(). Holds no pointers, so it stays valid for
+   as long as the buffer it was parsed from does, wherever that moves. */
+typedef struct http_request_s
+{
+    http_slice_t  method;
+    http_slice_t  target;           /* without the leading '/' and the query */
+    http_slice_t  query;            /* after '?', empty if none */
+    http_slice_t  body;             /* Content-Length bytes after the head, or the
+                                       chunked body as sent (framing included) */
+    uint64_t      content_length;   /* chunked: payload bytes decoded so far */
+    uint32_t      head_len;         /* request line + headers + final CRLF */
+    uint16_t      header_count;
+    uint8_t       method_code;      /* http_methods_code, or METHOD_COUNT */
+    uint8_t       http_major_version;
+    uint8_t       http_minor_version;
+    uint8_t       has_content_length;
+    uint8_t       chunked;          /* Transfer-Encoding: chunked */
+    int16_t       known[HDR_UNKNOWN];   /* index into headers[], -1 if absent */
+    http_header_t headers[HTTP_MAX_HEADERS];
+} http_request_t;
+
+/* Resumable parser: feed it the growing receive buffer and it continues
+   where it stopped, never looking at a byte twice. */
+typedef struct http_parser_s
+{
+    uint32_t        pos;            /* next byte to examine */
+    uint32_t        mark;           /* start of the token being scanned */
+    uint32_t        mark2;          /* '?' in the target, if any */
+    uint16_t        state;
+    uint16_t        error;          /* http_error_code once HTTP_PARSE_ERROR */
+    http_header_t   cur;            /* header line being scanned */
+    http_chunked_t  chunked;        /* framing of a chunked body */
+    http_request_t  req;
+} http_parser_t;
+
+/**
+*   @brief  Reset a parser for a new request starting at offset 0 of the
+*           buffer it will be fed.
+*/
+void http_parser_init(http_parser_t *parser);
+
+/**
+*   @brief  Consume buf[parser->pos .. length). `buf` holds every byte of the
+*           request received so far and may have moved since the last call;
+*           only the bytes past the previous `length` are new.
+*
+*   @return HTTP_PARSE_DONE (parser->req is complete and parser->pos is the
+*           request's total size), HTTP_PARSE_NEED_MORE or HTTP_PARSE_ERROR.
+*           DONE and ERROR are sticky until http_parser_init().
+*/
+http_parse_status http_parser_execute(http_parser_t *parser, const char *buf, size_t length);
+
+/**
+*   @brief  Whether the request line and all headers have been parsed, i.e.
+*           only body bytes may still be missing.
+*/
+int http_parser_head_done(const http_parser_t *parser);
+
+/**
+*   @brief  Parse a request without copying or allocating: every field is a
+*           slice of `buf`. Unknown headers are kept too. One-shot wrapper
+*           around http_parser_execute().
+*
+*   @param[in]  buf     request bytes (need not be '\0'-terminated)
+*   @param[in]  length  number of bytes in buf
+*   @param[out] req     parsed request
+*
+*   @return Ok, No_Content if the head is complete but the body is not all
+*           in `buf` yet, Bad_Request on malformed input.
+*/
+http_error_code http_request_parse(const char *buf, size_t length, http_request_t *req);
+
+/**
+*   @brief  Reset a chunked decoder for a new body.
+*/
+void http_chunked_init(http_chunked_t *dec);
+
+/**
+*   @brief  Decode the next `length` bytes of a chunked body. Payload bytes
+*           are appended to `out`, which may be `in` itself: the output never
+*           overtakes the input. With `out` NULL the framing is only checked
+*           and counted.
+*
+*   @param[out] used        bytes of `in` consumed; less than `length` only
+*                           once the body ended (the rest is the next message)
+*   @param[out] produced    payload bytes written to `out`
+*
+*   @return HTTP_PARSE_DONE after the last chunk and trailers,
+*           HTTP_PARSE_NEED_MORE or HTTP_PARSE_ERROR (sticky).
+*/
+http_parse_status http_chunked_decode(http_chunked_t *dec, const char *in, size_t length,
+                                      char *out, size_t *used, size_t *produced);
+
+/**
+*   @brief  Whether the decoder has seen the whole body.
+*/
+int http_chunked_done(const http_chunked_t *dec);
+
+/**
+*   @brief  Parse a Content-Length value (1*DIGIT, RFC 9110).
+*
+*   @return Ok, Bad_Request or Content_Too_Large.
+*/
+http_error_code http_parse_content_length(const char *field, size_t field_size, uint64_t *value);
+
+/**
+*   @brief  First header with the given id, or NULL.
+*/
+const http_header_t *http_request_header(const http_request_t *req, header_id id);
+
+/**
+*   @brief  First header whose name matches `name` case-insensitively, or NULL.
+*           Works for headers the parser does not recognise.
+*/
+const http_header_t *http_request_find(const http_request_t *req, const char *buf,
+                                       const char *name, size_t name_len);
+
+#endif // PARSER_H
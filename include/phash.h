@@ -0,0 +1,37 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Seeded FNV-1a, shared by tools/gen_phash.c (which searches for a seed
+   that makes a key set collision-free) and the lookups in http.c. The
+   generated tables live in bin/gen/http_phash.h. */
+static inline uint32_t phash(const char *key, size_t length, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; i++)
+        h = (h ^ (uint8_t)key[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+/* One slot of a generated table; key == NULL marks an empty slot. */
+typedef struct phash_slot_s
+{
+    const char *key;
+    uint8_t     len;
+    uint8_t     value;
+} phash_slot_t;
+
+/* The only candidate for `key` is the slot it hashes to: one memcmp. */
+static inline const phash_slot_t *phash_find(const phash_slot_t *table, uint32_t mask, uint32_t seed,
+                                             const char *key, size_t length)
+{
+    const phash_slot_t *slot = &table[phash(key, length, seed) & mask];
+    if (slot->len != length || slot->key == NULL || memcmp(slot->key, key, length) != 0)
+        return NULL;
+    return slot;
+}
+
+#endif // PHASH_H
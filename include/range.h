@@ -0,0 +1,29 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RANGE_MAX 16        /* more ranges than this and the header is ignored */
+
+/* Inclusive byte positions, as in content-Range. */
+typedef struct byte_range_s
+{
+    uint64_t first;
+    uint64_t last;
+} byte_range_t;
+
+/**
+*   @brief  Resolve a "bytes=" Range value against a representation of
+*           `size` bytes (RFC 9110 14.1.2). Suffix and open-ended ranges are
+*           clamped to the size; unsatisfiable ones are dropped; the rest are
+*           sorted and overlapping or adjacent ones merged.
+*
+*   @param[out] ranges  up to RANGE_MAX resolved ranges
+*
+*   @return The number of ranges, 0 if none is satisfiable (416), -1 if the
+*           header must be ignored (malformed, another unit, too many).
+*/
+int range_parse(const char *value, size_t length, uint64_t size, byte_range_t ranges[RANGE_MAX]);
+
+#endif // RANGE_H
@@ -0,0 +1,72 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Immutable index from request targets to resource ids, built once by
+   load_resources(). Exact names live in an open-addressed table hashed
+   with hash_index() from hash.c; directory prefixes in a compressed radix
+   trie. Both lookups cost O(target length), whatever the route count. */
+
+typedef struct radix_node_s
+{
+    char                 *label;        /* edge from the parent; "" for the root */
+    uint32_t              label_len;
+    int32_t               resource;     /* -1 if no prefix ends here */
+    uint16_t              child_count;
+    unsigned char        *first;        /* first label byte of each child */
+    struct radix_node_s **children;
+} radix_node_t;
+
+typedef struct route_index_s
+{
+    const char  **exact_keys;           /* NULL marks an empty slot */
+    int32_t      *exact_ids;
+    unsigned int  exact_capacity;       /* power of two, at least twice the count */
+    unsigned int  exact_count;
+    radix_node_t *prefixes;
+} route_index_t;
+
+/**
+*   @brief  Create an empty index able to hold `exact_count` exact names
+*           without growing.
+*
+*   @return The index, or NULL if out of memory.
+*/
+route_index_t *route_index_create(unsigned int exact_count);
+
+/**
+*   @brief  Free the index and everything it copied.
+*/
+void route_index_free(route_index_t *index);
+
+/**
+*   @brief  Map the exact target `name` to `id`. `name` is copied.
+*
+*   @return 0, 1 if the name was already present (the first id is kept),
+*           -1 on failure.
+*/
+int route_add_exact(route_index_t *index, const char *name, int32_t id);
+
+/**
+*   @brief  Map every target under the directory prefix `name` to `id`.
+*           "." is the root and matches every target. `name` is copied.
+*
+*   @return 0, 1 if the prefix was already present (the first id is kept),
+*           -1 on failure.
+*/
+int route_add_prefix(route_index_t *index, const char *name, int32_t id);
+
+/**
+*   @brief  Resource id registered for exactly `target`, or -1.
+*/
+int32_t route_find_exact(const route_index_t *index, const char *target);
+
+/**
+*   @brief  Resource id of the longest directory prefix of `target` that ends
+*           at a path component boundary ('/' or the end), or -1.
+*/
+int32_t route_find_prefix(const route_index_t *index, const char *target);
+
+#endif // ROUTE_H
@@ -0,0 +1,46 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/* Byte-scanning kernels behind the request parser. Each has a scalar
+   version and, on x86-64, SSE4.2 and AVX2 ones; scan_init() picks the
+   widest the CPU supports. Until it runs the scalar versions are used. */
+
+typedef enum {
+    SCAN_SCALAR = 0,
+    SCAN_SSE42,
+    SCAN_AVX2
+} scan_impl_t;
+
+typedef struct scan_ops_s
+{
+    /* First byte of [p, end) that cannot continue the token, or end.
+       name:   stops at ':', SP, any CTL or DEL
+       value:  stops at any CTL but HTAB, or DEL (so at CR and LF)
+       target: stops at '?', SP, any CTL or DEL */
+    const char *(*name_end)(const char *p, const char *end);
+    const char *(*value_end)(const char *p, const char *end);
+    const char *(*target_end)(const char *p, const char *end);
+
+    /* ASCII-lowercase n bytes of src into dst (may be the same buffer). */
+    void        (*lower)(char *dst, const char *src, size_t n);
+} scan_ops_t;
+
+extern scan_ops_t g_scan;
+
+/**
+*   @brief  Select the kernels for this CPU. `force` < 0 picks the best
+*           available; otherwise it names a scan_impl_t, clamped to what
+*           the CPU supports.
+*
+*   @return The implementation in use.
+*/
+scan_impl_t scan_init(int force);
+
+/**
+*   @brief  Name of an implementation, for logs.
+*/
+const char *scan_impl_name(scan_impl_t impl);
+
+#endif // SCAN_H
@@ -5,18 +5,38 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <pthread.h>
+#include "arena.h"
 #include "http.h"
 #include "utils.h"
 #include "config.h"
+#include "file_cache.h"
+#include "parser.h"
 
-#define BUFFER_SIZE         1000000
 #define STATUS_LINE_SIZE    50
 #define RESPONSE_BODY_SIZE  5000
 
+#define RESOURCE_DEFAULT_MAX_BODY   (1u << 20)  /* POST limit without a max_body= option */
+
 #define DEFAULT_RESPONSE "Content-Type: text/plain\r\n"\
                          "Connection: close\r\n"\
                          "\r\n"
 
+/* How hard a POST makes sure the new version is on disk before answering. */
+typedef enum
+{
+    FSYNC_NONE,         /* rename only: a crash may leave the old or an empty file */
+    FSYNC_FILE,         /* fdatasync the data before the rename (default) */
+    FSYNC_FULL          /* and fsync the directory after it */
+} fsync_policy_t;
+
+/* Resources answered by the server itself rather than from a file: the
+   type field of their resources.conf line names them. */
+typedef enum
+{
+    BUILTIN_NONE,
+    BUILTIN_METRICS     /* "metrics": counters in the Prometheus text format */
+} builtin_t;
+
 typedef struct resource_s
 {
     char              name[64];
@@ -25,30 +45,27 @@ typedef struct resource_s
     uint8_t           allowed_methods;   /* bitmask: (1 << http_methods_code) */
     uint8_t           is_directory;      /* 1 = serve files from directory, name is URL prefix */
     uint8_t           require_body;      /* 1 = POST must have content-length > 0 */
-    pthread_rwlock_t  rwlock;
+    uint8_t           builtin;           /* builtin_t; filename is unused unless BUILTIN_NONE */
+    char              cache_control[96]; /* cache_control=... option; "" = no header */
+    uint64_t          max_body;          /* max_body=... option: largest POST accepted */
+    uint8_t           fsync_policy;      /* fsync=none|file|full option */
+    pthread_mutex_t   commit_lock;       /* orders POSTs renaming over filename; readers never take it */
+    uint32_t          generation;        /* bumped by each committed POST */
 } resource_t;
 
 extern resource_t *g_resources;
 extern size_t      g_resource_count;
 
+/* Small files by path, and their gzip encodings by file identity (sized
+   from config.conf in main() before the workers start). */
+extern file_cache_t g_file_cache;
+extern file_cache_t g_gzip_cache;
+extern int          g_gzip_level;       /* 0 = only serve pre-compressed .gz sidecars */
+extern size_t       g_gzip_stream_max;  /* largest file compressed on the fly (chunked) */
+
 int  load_resources(const char *config_path);
 void free_resources(void);
 
-typedef enum
-{
-    HDR_HOST = 0,
-    HDR_CONNECTION,
-    HDR_CONTENT_LENGTH,
-    HDR_USER_AGENT,
-    HDR_CONTENT_TYPE,
-    HDR_ACCEPT,
-    HDR_ORIGIN,
-    HDR_REFERER,
-    HDR_ACCEPT_ENCODING,
-    HDR_ACCEPT_LANGUAGE,
-    HDR_UNKNOWN
-}header_id;
-
 typedef struct hdr_connection_s
 {
     uint8_t keep_alive;
@@ -82,7 +99,11 @@ typedef struct headers_s
     hdr_accept_enconding_t *accept_enconding;
     char                   *accept_language;
     char                   *accept;
-    
+
+    char *range;                        /* raw value, resolved against the file size when sending */
+    char *if_range;
+    char *if_none_match;
+    char *if_modified_since;
 }PACKED headers_t;
 
 typedef struct request_line_s
@@ -96,10 +117,15 @@ typedef struct request_line_s
 
 typedef struct http_message_s
 {
+    arena_t         *arena;           /* request-scoped memory, or NULL for the heap */
+    const struct http_request_s *request;   /* zero-copy view the fields below come from */
+    const char      *raw;             /* buffer `request` slices point into */
     request_line_t  request_line;
     int             resource_id;
     headers_t       headers;
     const char      *content;
+    uint64_t        content_received; /* body bytes in `content`; any rest is still on the socket */
+    http_chunked_t  *chunked;         /* decoder of a chunked body, past `content`; NULL if not chunked */
 }PACKED http_message_t;
 
 /*----------------------------------------------*/
@@ -107,21 +133,48 @@ typedef struct http_message_s
 /*----------------------------------------------*/
 
 /**
+*   @brief      Fill the typed field of `message` for one known header.
+*
+*   @param[in]  field       header value (need not be '\0'-terminated)
+*   @param[in]  field_size  length of the value
 *
+*   @return     Ok, Bad_Request on a duplicate or malformed value
 */
 http_error_code http_parse_header(http_message_t *message, const char *field, size_t field_size, header_id header_type);
 
 /**
-*   @brief
+*   @brief      Parse a request with http_request_parse() and copy the fields
+*               kept in http_message_t into request memory. parsed_message->request
+*               keeps the slices of every header, unknown ones included.
 *
 *   @param[in]  message         pointer to memory location of the message to be parsed
 *   @param[in]  message_size    number of bytes of the message to be parsed
 *   @param[out] parsed_message  pointer to memory location where to store the parsed message
 *
-*   @return
+*   @return     Ok, No_Content when the body is not complete yet, or an error
 */
 http_error_code http_parse_message(const char *message, size_t message_size, http_message_t *parsed_message);
 
+/**
+*   @brief      Fill `parsed_message` from a request the caller already parsed,
+*               e.g. the connection's resumable parser. `req` is borrowed, not
+*               copied, so it must outlive the message.
+*
+*   @param[out] parsed_message  message to fill; its arena must be set
+*   @param[in]  message         buffer `req` slices point into
+*   @param[in]  req             parsed request
+*
+*   @return     Ok, or an error from one of the known headers
+*/
+http_error_code http_message_from_request(http_message_t *parsed_message, const char *message,
+                                          const struct http_request_s *req);
+
+/**
+*   @brief      Whether the whole body of `parsed_message` has been read, i.e.
+*               the connection is in step for the next request.
+*/
+int http_body_complete(const http_message_t *parsed_message);
+
 /**
 *   @brief      Validate the HTTP message
 *
@@ -139,9 +192,11 @@ http_error_code http_validate_message(http_message_t *parsed_message);
 *
 *   @return     
 */
-/* Returns heap-allocated response body (headers + content); caller must free.
-   Sets *body_size to the exact byte count (binary-safe). */
-char *method_action(http_message_t *parsed_message, size_t *body_size);
+/* Returns the response body (headers + content), allocated like the other
+   request memory (see http_message_free). Sets *body_size to the exact
+   byte count (binary-safe). A POST body not yet received in full is read
+   from client_fd. */
+char *method_action(http_message_t *parsed_message, int client_fd, size_t *body_size);
 
 /**
 *   @brief      Builds an HTTP response based on the given error
@@ -149,12 +204,16 @@ char *method_action(http_message_t *parsed_message, size_t *body_size);
 *   @param[in]  error           HTTP error
 *   @param[in]  parsed_message  pointer to memory location of the parsed message
 *
-*   @return     Size of response message in bytes
+*   @return     Size of response message in bytes. *response comes from the
+*               message's arena (or the heap when it has none, and the caller
+*               frees it).
 */
 size_t http_build_response(http_error_code error, http_message_t *parsed_message, char **response, int client_fd);
 
 /**
-*   @brief      Release all heap-owned fields of an http_message_t and zero them.
+*   @brief      Release all request memory of an http_message_t and zero it,
+*               keeping the arena pointer. With an arena this is one
+*               arena_reset(); without one each heap field is freed.
 *               Safe to call repeatedly on the same struct.
 */
 void http_message_free(http_message_t *message);
@@ -3,44 +3,194 @@
 
 #include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/* Build with -DTHREAD_POOL_MUTEX for the plain mutex + condition variable
+   queue, e.g. to compare it with the lock-free one under load. That build
+   has no work-stealing mode. */
+
+#define TP_CACHE_LINE   64
+#define TP_DEQUE_SIZE   256     /* follow-up tasks a worker can hold locally */
+
+#define TP_DEFAULT_MIN_WORKERS      4
+#define TP_DEFAULT_MAX_WORKERS      64
+#define TP_DEFAULT_IDLE_TIMEOUT_MS  10000
+#define TP_DEFAULT_QUEUE_CAPACITY   64
 
 typedef void (*tp_work_fn)(int client_fd);
 
+/* A unit of work: fn(fd). New connections run the pool's work function;
+   follow-ups on a connection (the rest of a long pipeline, see
+   handle_client()) are tasks on the same fd, requeued by the worker. */
+typedef struct tp_task_s
+{
+    tp_work_fn fn;
+    int        fd;
+} tp_task_t;
+
+typedef enum
+{
+    TP_SHARED = 0,              /* every worker pulls from one ring */
+    TP_STEALING                 /* per-worker queues, idle workers steal */
+} tp_mode_t;
+
+#ifndef THREAD_POOL_MUTEX
+/* Ring cell: `seq` says whose turn it is (Vyukov's bounded MPMC queue). */
+typedef struct tp_slot_s
+{
+    uint64_t  seq;
+    tp_task_t task;
+} tp_slot_t;
+
+typedef struct tp_ring_s
+{
+    tp_slot_t *slots;
+    size_t     mask;               /* capacity - 1, a power of two */
+
+    /* Producers and consumers each write their own cache line. */
+    char       pad0[TP_CACHE_LINE];
+    uint64_t   enqueue_pos;
+    char       pad1[TP_CACHE_LINE - sizeof(uint64_t)];
+    uint64_t   dequeue_pos;
+    char       pad2[TP_CACHE_LINE - sizeof(uint64_t)];
+} tp_ring_t;
+
+/* Bounded Chase-Lev deque: the owner pushes and pops at the bottom
+   (newest first, while its state is warm), thieves take from the top. */
+typedef struct tp_deque_s
+{
+    tp_task_t *tasks;
+    char       pad0[TP_CACHE_LINE];
+    int64_t    top;
+    char       pad1[TP_CACHE_LINE - sizeof(int64_t)];
+    int64_t    bottom;
+    char       pad2[TP_CACHE_LINE - sizeof(int64_t)];
+} tp_deque_t;
+#endif
+
+typedef struct tp_config_s
+{
+    size_t    min_workers;          /* always running */
+    size_t    max_workers;          /* ceiling while the queue backs up */
+    unsigned  idle_timeout_ms;      /* a parked worker above the minimum retires after this */
+    size_t    queue_capacity;       /* tasks queued in total before submit fails */
+    tp_mode_t mode;
+    int       cpu;                  /* pin every worker to this CPU; -1 = don't */
+} tp_config_t;
+
+/* A worker slot. Slots are allocated for max_workers up front and reused:
+   `running` says whether a thread currently owns this one. */
+typedef struct tp_worker_s
+{
+    pthread_t             thread;
+    struct thread_pool_s *pool;
+    size_t                index;
+    uint32_t              running;
+    uint64_t              tasks;       /* run by the threads of this slot so far */
+    uint64_t              busy_ns;     /* time spent running them */
+#ifndef THREAD_POOL_MUTEX
+    tp_ring_t             inbox;       /* TP_STEALING: tasks submitted to this worker */
+    tp_deque_t            deque;       /* TP_STEALING: its own follow-ups */
+#endif
+} tp_worker_t;
+
 typedef struct thread_pool_s
 {
-    pthread_t       *workers;
-    size_t           worker_count;
+    tp_worker_t     *workers;          /* max_workers slots */
+    size_t           min_workers;
+    size_t           max_workers;
+    unsigned         idle_timeout_ms;
+    int              cpu;
+    tp_work_fn       work_fn;
+    tp_mode_t        mode;
+
+    size_t           slots_used;       /* high-water mark of slots given a thread */
+    uint32_t         live;             /* threads running */
+    uint32_t         spawning;         /* a submitter is starting one */
+    uint64_t         spawned;          /* threads started after init */
+    uint64_t         retired;
 
-    int             *queue;            /* ring buffer of client fds */
+#ifdef THREAD_POOL_MUTEX
+    tp_task_t       *queue;            /* ring buffer of tasks */
     size_t           queue_capacity;
     size_t           queue_head;       /* next slot to dequeue */
     size_t           queue_tail;       /* next slot to enqueue */
-    size_t           queue_size;       /* number of fds currently queued */
+    size_t           queue_size;       /* number of tasks currently queued */
+
+    size_t           idle;             /* workers waiting on not_empty */
 
     pthread_mutex_t  lock;
     pthread_cond_t   not_empty;
+#else
+    tp_ring_t        ring;             /* TP_SHARED */
+    uint64_t         next_worker;      /* TP_STEALING: round-robin submit target */
 
-    tp_work_fn       work_fn;
+    char             pad0[TP_CACHE_LINE];
+    uint32_t         wake_seq;         /* futex word, bumped by every wake-up */
+    uint32_t         sleepers;         /* workers parked or about to */
+    uint32_t         wake_pending;     /* a wake-up is issued and no sleeper has left yet */
+    char             pad1[TP_CACHE_LINE - 3 * sizeof(uint32_t)];
+#endif
 } thread_pool_t;
 
+typedef struct tp_stats_s
+{
+    size_t   workers;               /* running now */
+    size_t   idle;                  /* of which parked waiting for work */
+    size_t   min_workers;
+    size_t   max_workers;
+    size_t   queued;                /* tasks waiting, approximate */
+    uint64_t spawned;
+    uint64_t retired;
+    uint64_t tasks;
+    uint64_t busy_ns;               /* over time / workers: utilization */
+} tp_stats_t;
+
 /**
-*   @brief  Initialise the pool: spawn `worker_count` threads, allocate a queue
-*          of `queue_capacity` fds, and store the work function each worker runs
-*          on every dequeued fd.
+*   @brief  Initialise the pool: allocate queues for `queue_capacity` tasks
+*           (rounded up to a power of two per queue; in TP_STEALING mode
+*           split between the first `min_workers` inboxes, each added worker
+*           bringing as much again) and slots for `max_workers`, and start
+*           `min_workers` threads, each running `work_fn` on every
+*           submitted fd.
+*
+*           The pool grows by one thread whenever a task is submitted while
+*           another is still waiting and no worker is parked, up to
+*           `max_workers`. A worker that has been parked for
+*           `idle_timeout_ms` exits while more than `min_workers` run.
 *
 *   @return 0 on success, -1 on failure.
 */
-int  thread_pool_init(thread_pool_t *pool,
-                      size_t worker_count,
-                      size_t queue_capacity,
-                      tp_work_fn work_fn);
+int  thread_pool_init(thread_pool_t *pool, const tp_config_t *config, tp_work_fn work_fn);
 
 /**
-*   @brief  Hand a client fd to the pool. If the queue is full, the fd is
-*           closed and the call returns -1 (silent overload protection).
+*   @brief  Hand a client fd to the pool, to be run with the work function.
+*           If the queues are full the call returns -1 and the fd stays with
+*           the caller, which decides how to drop it. Safe from any number
+*           of threads; wakes at most one parked worker.
 *
 *   @return 0 if accepted, -1 if dropped.
 */
 int  thread_pool_submit(thread_pool_t *pool, int client_fd);
 
+/**
+*   @brief  As thread_pool_submit() for any task.
+*/
+int  thread_pool_submit_task(thread_pool_t *pool, tp_task_t task);
+
+/**
+*   @brief  Queue a follow-up task from inside a task. In TP_STEALING mode it
+*           goes on the calling worker's own deque, so it most likely runs
+*           next on the same core unless an idle worker steals it; otherwise
+*           (or when that deque is full) it is submitted like any task.
+*
+*   @return 0 if queued, -1 if every queue is full.
+*/
+int  thread_pool_requeue(thread_pool_t *pool, tp_task_t task);
+
+/**
+*   @brief  Snapshot of the pool's size and counters.
+*/
+void thread_pool_get_stats(thread_pool_t *pool, tp_stats_t *stats);
+
 #endif // THREAD_POOL_H
@@ -0,0 +1,110 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES       1024    /* reactor ring size */
+#define URING_BUF_GROUP     0       /* provided-buffer group id used for recv */
+#define URING_BUF_COUNT     256     /* provided buffers, power of two */
+#define URING_BUF_SIZE      16384   /* bytes per provided buffer */
+#define URING_SEND_ENTRIES  32      /* per-worker ring used for file bodies */
+#define URING_PIPE_SIZE     (1 << 20)
+
+/* Minimal io_uring instance over the raw syscalls (no liburing). */
+typedef struct uring_s
+{
+    int                   ring_fd;
+
+    unsigned             *sq_head;
+    unsigned             *sq_tail;
+    unsigned              sq_mask;
+    unsigned             *sq_array;
+    struct io_uring_sqe  *sqes;
+    unsigned              sqe_tail;    /* local tail, published on submit */
+
+    unsigned             *cq_head;
+    unsigned             *cq_tail;
+    unsigned              cq_mask;
+    struct io_uring_cqe  *cqes;
+
+    void                 *ring_ptr;
+    size_t                ring_len;
+    size_t                sqes_len;
+} uring_t;
+
+/* Kernel-shared ring of provided buffers (IORING_REGISTER_PBUF_RING). */
+typedef struct uring_buf_ring_s
+{
+    struct io_uring_buf_ring *ring;
+    char                     *base;    /* URING_BUF_COUNT * URING_BUF_SIZE */
+    size_t                    ring_len;
+    uint16_t                  tail;
+} uring_buf_ring_t;
+
+/**
+*   @brief  Check that the running kernel has what the io_uring backend
+*           needs: multishot accept, provided buffer rings, send and splice.
+*
+*   @return 1 if supported, 0 otherwise.
+*/
+int  uring_supported(void);
+
+/**
+*   @brief  Create and map a ring with `entries` submission slots.
+*
+*   @return 0 on success, -1 on failure.
+*/
+int  uring_init(uring_t *ring, unsigned entries);
+
+void uring_exit(uring_t *ring);
+
+/**
+*   @brief  Next free submission entry, zeroed. Returns NULL when the
+*           submission queue is full; call uring_submit() and retry.
+*/
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+/**
+*   @brief  Publish queued entries to the kernel and wait for at least
+*           `wait_nr` completions.
+*
+*   @return Number of entries submitted, or -errno.
+*/
+int  uring_submit(uring_t *ring, unsigned wait_nr);
+
+/**
+*   @brief  Oldest unconsumed completion, or NULL if the queue is empty.
+*           Release it with uring_cqe_seen().
+*/
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring);
+
+void uring_cqe_seen(uring_t *ring);
+
+/**
+*   @brief  Allocate URING_BUF_COUNT buffers and register them as provided
+*           buffer group URING_BUF_GROUP of `ring`.
+*
+*   @return 0 on success, -1 on failure.
+*/
+int  uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs);
+
+/* Start of provided buffer `bid`. */
+char *uring_buf_ring_get(uring_buf_ring_t *bufs, uint16_t bid);
+
+/* Give buffer `bid` back to the kernel once its bytes were consumed. */
+void uring_buf_ring_recycle(uring_buf_ring_t *bufs, uint16_t bid);
+
+/**
+*   @brief  Send `head` followed by `count` bytes of file_fd from `offset`,
+*           as one linked send + splice chain on a per-thread ring. Falls back
+*           to send()/sendfile() when the thread has no ring.
+*
+*   @return 0 on success, -1 on failure.
+*/
+int  uring_send_file(int sock_fd, const void *head, size_t head_len,
+                     int file_fd, off_t offset, size_t count);
+
+#endif // URING_H
@@ -1,17 +1,71 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 #define TRUE 1
 #define FALSE 0
 
 #define PACKED __attribute__((packed))
 
+#define IO_TIMEOUT_MS 30000     /* max wait for a non-blocking socket to drain */
+
 char *strstrcpy(const char *src, size_t length);
 
 void lowercase(char *string, size_t length);
 
+/* CLOCK_MONOTONIC in nanoseconds. */
+uint64_t monotonic_ns(void);
+
+/* What the calling thread sent through the helpers below since
+   send_meter_reset(): the byte count, and the status code of the first
+   response head among it (0 if none yet). Feeds the access log. */
+typedef struct send_meter_s
+{
+    uint64_t bytes;
+    uint16_t status;
+} send_meter_t;
+
+extern __thread send_meter_t t_send_meter;
+
+void send_meter_reset(void);
+
+/* Account `sent` bytes starting with buf; used by senders outside this
+   file (uring.c). */
+void send_meter_add(const void *buf, size_t sent);
+
+/* Wait up to IO_TIMEOUT_MS for fd to become readable. Returns 0 when it
+   is, -1 on error or timeout. */
+int wait_readable(int fd);
+
+/* Write all of buf to a (possibly non-blocking) socket, waiting for POLLOUT
+   on EAGAIN. Returns 0 on success, -1 on error or timeout. */
+int send_all(int fd, const void *buf, size_t length);
+
+/* sendfile() `count` bytes of in_fd starting at offset to a (possibly
+   non-blocking) socket. Returns 0 on success, -1 on error or timeout. */
+int sendfile_all(int out_fd, int in_fd, off_t offset, size_t count);
+
+/* Gather-write every iovec to a (possibly non-blocking) socket in as few
+   syscalls as the socket allows. Consumes `iov` (entries are advanced in
+   place). Returns 0 on success, -1 on error or timeout. */
+int sendv_all(int fd, struct iovec *iov, int iovcnt);
+
+/* pread() exactly `length` bytes of fd starting at offset. Returns 0 on
+   success, -1 on error or if the file came up short. */
+int pread_all(int fd, void *buf, size_t length, off_t offset);
+
+/* write() all of buf to a file. Returns 0 on success, -1 on error. */
+int write_all(int fd, const void *buf, size_t length);
+
+/* Move `count` bytes from a socket into file_fd at its current offset:
+   spliced through a pipe, or through a fixed bounce buffer where splice
+   does not apply. Memory use is constant whatever the count. *moved says
+   how far it got. Returns 0 on success, -1 on error, EOF or timeout. */
+int recv_to_file(int sock_fd, int file_fd, uint64_t count, uint64_t *moved);
+
 #endif // UTILS_H
\ No newline at end of file
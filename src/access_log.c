@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/access_log.h"
+#include "../include/config.h"
+
+static access_log_header_t *g_access_header  = NULL;
+static access_record_t     *g_access_records = NULL;
+
+int access_log_open(const char *path, uint64_t capacity)
+{
+    if (capacity == 0) return -1;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        log_write(LOG_ERROR, "access log %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    size_t size = sizeof(access_log_header_t) + (size_t)capacity * sizeof(access_record_t);
+
+    /* Continue a log of the same shape; anything else starts over. */
+    access_log_header_t old;
+    struct stat st;
+    int reuse = (fstat(fd, &st) == 0 && (size_t)st.st_size == size &&
+                 pread(fd, &old, sizeof(old), 0) == (ssize_t)sizeof(old) &&
+                 memcmp(old.magic, ACCESS_LOG_MAGIC, sizeof(old.magic)) == 0 &&
+                 old.version == ACCESS_LOG_VERSION && old.record_size == sizeof(access_record_t) &&
+                 old.capacity == capacity);
+
+    if (!reuse && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0))
+    {
+        log_write(LOG_ERROR, "access log %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        log_write(LOG_ERROR, "access log %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    access_log_header_t *header = map;
+    if (!reuse)
+    {
+        memcpy(header->magic, ACCESS_LOG_MAGIC, sizeof(header->magic));
+        header->version     = ACCESS_LOG_VERSION;
+        header->record_size = sizeof(access_record_t);
+        header->capacity    = capacity;
+        header->next        = 0;
+    }
+
+    g_access_records = (access_record_t *)(header + 1);
+    g_access_header  = header;
+    return 0;
+}
+
+int access_log_enabled(void)
+{
+    return g_access_header != NULL;
+}
+
+void access_log_write(access_record_t *record)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->wall_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    uint64_t index = __atomic_fetch_add(&g_access_header->next, 1, __ATOMIC_RELAXED);
+    access_record_t *slot = &g_access_records[index % g_access_header->capacity];
+
+    /* Readers trust a slot only once seq matches; clear it first so a
+       half-copied record never carries the previous owner's seq. */
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)slot + sizeof(slot->seq), (const char *)record + sizeof(record->seq),
+           sizeof(*record) - sizeof(record->seq));
+    __atomic_store_n(&slot->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+void access_record_set_target(access_record_t *record, const char *target, size_t length)
+{
+    size_t len = (length < ACCESS_TARGET_MAX - 2) ? length : ACCESS_TARGET_MAX - 2;
+    record->target[0] = '/';
+    memcpy(record->target + 1, target, len);
+}
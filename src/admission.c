@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "../include/admission.h"
+#include "../include/http.h"
+
+#define NS_PER_MS   1000000ull
+
+void admission_init(admission_t *adm, unsigned target_ms, unsigned interval_ms, unsigned retry_after)
+{
+    memset(adm, 0, sizeof(*adm));
+    adm->target_ns   = (uint64_t)target_ms * NS_PER_MS;
+    adm->interval_ns = (uint64_t)(interval_ms > 0 ? interval_ms : 1) * NS_PER_MS;
+
+    int n = snprintf(adm->reply, sizeof(adm->reply),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: text/plain\r\n"
+                     "Content-Length: 0\r\n"
+                     "Retry-After: %u\r\n"
+                     "Connection: close\r\n"
+                     "\r\n",
+                     Service_Unavailable, get_http_error_name(Service_Unavailable), retry_after);
+    adm->reply_len = (n > 0 && (size_t)n < sizeof(adm->reply)) ? (size_t)n : 0;
+}
+
+uint64_t admission_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t isqrt(uint64_t x)
+{
+    uint64_t r = 0, bit = 1ull << 62;
+    while (bit > x) bit >>= 2;
+    while (bit != 0)
+    {
+        if (x >= r + bit) { x -= r + bit; r = (r >> 1) + bit; }
+        else              r >>= 1;
+        bit >>= 2;
+    }
+    return r;
+}
+
+/* CoDel's control law: shed faster the longer the episode lasts. */
+static uint64_t control_law(const admission_t *adm, uint64_t t)
+{
+    uint64_t root = isqrt(adm->shed_count);
+    return t + adm->interval_ns / (root > 0 ? root : 1);
+}
+
+int admission_admit(admission_t *adm, uint64_t now_ns)
+{
+    if (adm->target_ns == 0 || !__atomic_load_n(&adm->overloaded, __ATOMIC_RELAXED))
+    {
+        adm->shedding = 0;
+        return 1;
+    }
+
+    if (!adm->shedding)
+    {
+        /* A new episode soon after the last one resumes near its rate. */
+        adm->shedding   = 1;
+        adm->shed_count = (adm->shed_count > 2 && now_ns - adm->shed_next_ns < 16 * adm->interval_ns)
+                          ? adm->shed_count - 2 : 1;
+        adm->shed_next_ns = now_ns;
+    }
+
+    if (now_ns < adm->shed_next_ns) return 1;
+
+    /* Only admitted dispatches report a delay. If nothing arrived for an
+       interval past the scheduled shed, the queue has had time to drain:
+       let this one through to find out, or sparse traffic is shed forever. */
+    if (now_ns - adm->shed_next_ns > adm->interval_ns)
+    {
+        adm->shed_next_ns = control_law(adm, now_ns);
+        return 1;
+    }
+
+    adm->shed_count++;
+    adm->shed_next_ns = control_law(adm, now_ns);
+    return 0;
+}
+
+void admission_dequeued(admission_t *adm, uint64_t queued_ns)
+{
+    uint64_t now   = admission_now();
+    uint64_t delay = (now > queued_ns) ? now - queued_ns : 0;
+
+    __atomic_add_fetch(&adm->delay_sum_ns, delay, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&adm->delay_count, 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&adm->delay_max_ns, __ATOMIC_RELAXED);
+    while (delay > max &&
+           !__atomic_compare_exchange_n(&adm->delay_max_ns, &max, delay, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    if (adm->target_ns == 0) return;
+
+    /* Only write the shared words on a change, so workers below target do
+       not bounce the line between them. */
+    if (delay < adm->target_ns)
+    {
+        if (__atomic_load_n(&adm->first_above_ns, __ATOMIC_RELAXED) != 0)
+            __atomic_store_n(&adm->first_above_ns, 0, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&adm->overloaded, __ATOMIC_RELAXED))
+            __atomic_store_n(&adm->overloaded, 0, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t first = __atomic_load_n(&adm->first_above_ns, __ATOMIC_RELAXED);
+    if (first == 0)
+    {
+        __atomic_compare_exchange_n(&adm->first_above_ns, &first, now + adm->interval_ns, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return;
+    }
+    if (now >= first && !__atomic_load_n(&adm->overloaded, __ATOMIC_RELAXED))
+        __atomic_store_n(&adm->overloaded, 1, __ATOMIC_RELAXED);
+}
+
+void admission_reject(admission_t *adm, int fd, int full)
+{
+    __atomic_add_fetch(full ? &adm->shed_full : &adm->shed_delay, 1, __ATOMIC_RELAXED);
+
+    /* A fresh socket buffer always has room for it; if not, the peer is
+       getting a close either way. */
+    if (adm->reply_len > 0)
+        (void)send(fd, adm->reply, adm->reply_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+void admission_get_stats(admission_t *adm, admission_stats_t *stats)
+{
+    stats->shed_delay   = __atomic_load_n(&adm->shed_delay,   __ATOMIC_RELAXED);
+    stats->shed_full    = __atomic_load_n(&adm->shed_full,    __ATOMIC_RELAXED);
+    stats->delay_sum_ns = __atomic_load_n(&adm->delay_sum_ns, __ATOMIC_RELAXED);
+    stats->delay_count  = __atomic_load_n(&adm->delay_count,  __ATOMIC_RELAXED);
+    stats->delay_max_ns = __atomic_load_n(&adm->delay_max_ns, __ATOMIC_RELAXED);
+    stats->shedding     = (int)__atomic_load_n(&adm->overloaded, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/arena.h"
+#include "../include/buffer_pool.h"
+
+#define HEADER_SIZE ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static arena_block_t *block_new(size_t payload)
+{
+    size_t want = HEADER_SIZE + payload;
+    if (want < ARENA_BLOCK_SIZE) want = ARENA_BLOCK_SIZE;
+
+    /* Oversized requests bypass the pool; block_release() tells them apart
+       by size. */
+    size_t size = want;
+    char *mem = (want <= BUF_POOL_MAX_SIZE) ? buffer_pool_acquire(want, &size)
+                                            : malloc(want);
+    if (mem == NULL) return NULL;
+
+    arena_block_t *block = (arena_block_t *)mem;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void block_release(arena_block_t *block)
+{
+    if (block->size <= BUF_POOL_MAX_SIZE)
+        buffer_pool_release((char *)block, block->size);
+    else
+        free(block);
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    arena_block_t *block = arena->blocks;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (block == NULL || HEADER_SIZE + block->used + size > block->size)
+    {
+        block = block_new(size);
+        if (block == NULL) return NULL;
+        block->next   = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void *ptr = (char *)block + HEADER_SIZE + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char *arena_strndup(arena_t *arena, const char *src, size_t length)
+{
+    if (src == NULL) return NULL;
+
+    char *dst = arena_alloc(arena, length + 1);
+    if (dst == NULL) return NULL;
+    memcpy(dst, src, length);
+    dst[length] = '\0';
+    return dst;
+}
+
+void arena_reset(arena_t *arena)
+{
+    arena_block_t *block = arena->blocks;
+    if (block == NULL) return;
+
+    while (block->next != NULL)
+    {
+        arena_block_t *next = block->next;
+        block_release(block);
+        block = next;
+    }
+
+    block->used   = 0;
+    arena->blocks = block;
+}
+
+void arena_free(arena_t *arena)
+{
+    arena_block_t *block = arena->blocks;
+    while (block != NULL)
+    {
+        arena_block_t *next = block->next;
+        block_release(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
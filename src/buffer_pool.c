@@ -0,0 +1,274 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/buffer_pool.h"
+
+/* Free buffers are chained through their own first bytes. */
+typedef struct free_buf_s
+{
+    struct free_buf_s *next;
+} free_buf_t;
+
+typedef struct thread_cache_s
+{
+    free_buf_t            *free[BUF_POOL_CLASSES];
+    unsigned               count[BUF_POOL_CLASSES];
+    uint64_t               hits;
+    uint64_t               misses;
+    uint64_t               released;
+    uint32_t               owned;       /* a live thread uses it */
+    struct thread_cache_s *next;        /* registry, for stats */
+} thread_cache_t;
+
+typedef struct depot_s
+{
+    pthread_mutex_t lock;
+    free_buf_t     *free;
+    unsigned        count;
+} depot_t;
+
+static depot_t          g_depot[BUF_POOL_CLASSES];
+static thread_cache_t  *g_caches      = NULL;
+static pthread_mutex_t  g_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    g_cache_key;
+static pthread_once_t   g_once        = PTHREAD_ONCE_INIT;
+static uint64_t         g_released    = 0;      /* by trim and exiting threads */
+
+static __thread thread_cache_t *t_cache = NULL;
+
+static unsigned cache_limit(unsigned cls)
+{
+    unsigned n = BUF_POOL_CACHE_BYTES >> (cls + BUF_POOL_MIN_SHIFT);
+    return (n > 0) ? n : 1;
+}
+
+static unsigned depot_limit(unsigned cls)
+{
+    unsigned n = BUF_POOL_DEPOT_BYTES >> (cls + BUF_POOL_MIN_SHIFT);
+    return (n > 0) ? n : 1;
+}
+
+static int size_class(size_t size)
+{
+    if (size > BUF_POOL_MAX_SIZE) return -1;
+
+    unsigned cls = 0;
+    while (((size_t)1 << (cls + BUF_POOL_MIN_SHIFT)) < size) cls++;
+    return (int)cls;
+}
+
+/* Park buf in the depot; returns 0 if the depot for this class is full. */
+static int depot_put(unsigned cls, free_buf_t *buf)
+{
+    depot_t *d = &g_depot[cls];
+    int stored = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->count < depot_limit(cls))
+    {
+        buf->next = d->free;
+        d->free   = buf;
+        d->count++;
+        stored = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return stored;
+}
+
+static free_buf_t *depot_take(unsigned cls)
+{
+    depot_t *d = &g_depot[cls];
+
+    pthread_mutex_lock(&d->lock);
+    free_buf_t *buf = d->free;
+    if (buf != NULL)
+    {
+        d->free = buf->next;
+        d->count--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return buf;
+}
+
+/* A thread is going away: its free lists go to the depot (or the
+   allocator) and the struct stays registered, counters and all, for the
+   next thread to take over. */
+static void cache_destroy(void *arg)
+{
+    thread_cache_t *cache = arg;
+
+    for (unsigned cls = 0; cls < BUF_POOL_CLASSES; cls++)
+    {
+        while (cache->free[cls] != NULL)
+        {
+            free_buf_t *buf = cache->free[cls];
+            cache->free[cls] = buf->next;
+            if (!depot_put(cls, buf))
+            {
+                free(buf);
+                __atomic_add_fetch(&cache->released, 1, __ATOMIC_RELAXED);
+            }
+        }
+        cache->count[cls] = 0;
+    }
+    __atomic_store_n(&cache->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void pool_init_once(void)
+{
+    for (unsigned cls = 0; cls < BUF_POOL_CLASSES; cls++)
+        pthread_mutex_init(&g_depot[cls].lock, NULL);
+    pthread_key_create(&g_cache_key, cache_destroy);
+}
+
+static thread_cache_t *thread_cache(void)
+{
+    if (t_cache != NULL) return t_cache;
+
+    pthread_once(&g_once, pool_init_once);
+
+    /* Reuse one a finished thread left behind, so an elastic pool that
+       keeps starting workers does not grow the registry without bound. */
+    pthread_mutex_lock(&g_caches_lock);
+    thread_cache_t *cache = g_caches;
+    while (cache != NULL && __atomic_load_n(&cache->owned, __ATOMIC_ACQUIRE))
+        cache = cache->next;
+
+    if (cache == NULL)
+    {
+        cache = calloc(1, sizeof(thread_cache_t));
+        if (cache == NULL)
+        {
+            pthread_mutex_unlock(&g_caches_lock);
+            return NULL;
+        }
+        cache->next = g_caches;
+        g_caches    = cache;
+    }
+    __atomic_store_n(&cache->owned, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_caches_lock);
+
+    pthread_setspecific(g_cache_key, cache);
+    t_cache = cache;
+    return cache;
+}
+
+char *buffer_pool_acquire(size_t size, size_t *class_size)
+{
+    int cls = size_class(size);
+    if (cls < 0) return NULL;
+
+    thread_cache_t *cache = thread_cache();
+    if (cache == NULL) return NULL;
+
+    *class_size = (size_t)1 << (cls + BUF_POOL_MIN_SHIFT);
+
+    free_buf_t *buf = cache->free[cls];
+    if (buf != NULL)
+    {
+        cache->free[cls] = buf->next;
+        cache->count[cls]--;
+    }
+    else
+    {
+        buf = depot_take((unsigned)cls);
+    }
+
+    if (buf != NULL)
+    {
+        __atomic_store_n(&cache->hits, cache->hits + 1, __ATOMIC_RELAXED);
+        return (char *)buf;
+    }
+
+    __atomic_store_n(&cache->misses, cache->misses + 1, __ATOMIC_RELAXED);
+    char *mem = malloc(*class_size);
+    if (mem == NULL)
+    {
+        buffer_pool_trim();
+        mem = malloc(*class_size);
+    }
+    return mem;
+}
+
+void buffer_pool_release(char *buf, size_t class_size)
+{
+    if (buf == NULL) return;
+
+    int cls = size_class(class_size);
+    thread_cache_t *cache = thread_cache();
+    if (cls < 0 || cache == NULL) { free(buf); return; }
+
+    free_buf_t *node = (free_buf_t *)buf;
+    if (cache->count[cls] < cache_limit((unsigned)cls))
+    {
+        node->next = cache->free[cls];
+        cache->free[cls] = node;
+        cache->count[cls]++;
+        return;
+    }
+
+    if (depot_put((unsigned)cls, node)) return;
+
+    free(buf);
+    __atomic_store_n(&cache->released, cache->released + 1, __ATOMIC_RELAXED);
+}
+
+char *buffer_pool_grow(char *buf, size_t used, size_t *class_size)
+{
+    size_t new_size;
+    char *bigger = buffer_pool_acquire(*class_size * 2, &new_size);
+    if (bigger == NULL) return NULL;
+
+    if (used > 0) memcpy(bigger, buf, used);
+    buffer_pool_release(buf, *class_size);
+    *class_size = new_size;
+    return bigger;
+}
+
+void buffer_pool_trim(void)
+{
+    pthread_once(&g_once, pool_init_once);
+
+    for (unsigned cls = 0; cls < BUF_POOL_CLASSES; cls++)
+    {
+        depot_t *d = &g_depot[cls];
+
+        pthread_mutex_lock(&d->lock);
+        free_buf_t *buf = d->free;
+        unsigned    n   = d->count;
+        d->free  = NULL;
+        d->count = 0;
+        pthread_mutex_unlock(&d->lock);
+
+        while (buf != NULL)
+        {
+            free_buf_t *next = buf->next;
+            free(buf);
+            buf = next;
+        }
+        __atomic_add_fetch(&g_released, n, __ATOMIC_RELAXED);
+    }
+}
+
+void buffer_pool_get_stats(buffer_pool_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_once(&g_once, pool_init_once);
+
+    pthread_mutex_lock(&g_caches_lock);
+    for (thread_cache_t *c = g_caches; c != NULL; c = c->next)
+    {
+        stats->hits     += __atomic_load_n(&c->hits,     __ATOMIC_RELAXED);
+        stats->misses   += __atomic_load_n(&c->misses,   __ATOMIC_RELAXED);
+        stats->released += __atomic_load_n(&c->released, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&g_caches_lock);
+    stats->released += __atomic_load_n(&g_released, __ATOMIC_RELAXED);
+
+    for (unsigned cls = 0; cls < BUF_POOL_CLASSES; cls++)
+    {
+        pthread_mutex_lock(&g_depot[cls].lock);
+        stats->depot_bytes += (size_t)g_depot[cls].count << (cls + BUF_POOL_MIN_SHIFT);
+        pthread_mutex_unlock(&g_depot[cls].lock);
+    }
+}
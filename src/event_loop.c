@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "../include/access_log.h"
+#include "../include/buffer_pool.h"
+#include "../include/config.h"
+#include "../include/event_loop.h"
+#include "../include/metrics.h"
+#include "../include/server.h"
+#include "../include/uring.h"
+
+#define CONN_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+
+/* io_uring user_data for the non-connection requests; connections use
+   their (aligned) pointer. */
+#define TAG_ACCEPT  1
+#define TAG_WAKE    2
+
+static void uring_queue_recv(event_loop_t *loop, connection_t *conn);
+
+/* fd -> connection. fds are unique per process, so the table is shared by
+   every loop; a slot is only written by the thread that owns the connection. */
+static connection_t **g_conns      = NULL;
+static size_t         g_conns_size = 0;
+static size_t         g_conns_live = 0;
+
+static int conn_table_init(void)
+{
+    if (g_conns != NULL) return 0;
+
+    /* Every connection costs an fd: lift the soft limit as far as allowed. */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return -1;
+    if (rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    g_conns_size = (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > 1048576)
+                   ? 1048576 : (size_t)rl.rlim_cur;
+    g_conns = calloc(g_conns_size, sizeof(connection_t *));
+    return (g_conns == NULL) ? -1 : 0;
+}
+
+/* Make room for the next read: attach an initial slab to an idle
+   connection, or move a full one to the next size class.
+   Returns 1 if there is room, 0 if the buffer is at its maximum size,
+   -1 if no memory could be had. */
+static int conn_buf_reserve(connection_t *conn)
+{
+    size_t size;
+
+    if (conn->buf == NULL)
+    {
+        conn->buf = buffer_pool_acquire(CONN_BUFFER_INITIAL, &size);
+        if (conn->buf == NULL) return -1;
+        conn->cap = size - 1;           /* keep room for the parser's '\0' */
+        return 1;
+    }
+
+    if (conn->len < conn->cap) return 1;
+    if (conn->cap + 1 >= CONN_BUFFER_MAX) return 0;
+
+    size = conn->cap + 1;
+    char *grown = buffer_pool_grow(conn->buf, conn->len, &size);
+    if (grown == NULL) return -1;
+    conn->buf = grown;
+    conn->cap = size - 1;
+    return 1;
+}
+
+static void conn_buf_release(connection_t *conn)
+{
+    if (conn->buf == NULL) return;
+    buffer_pool_release(conn->buf, conn->cap + 1);
+    conn->buf = NULL;
+    conn->cap = 0;
+    conn->len = 0;
+}
+
+/* Only dispatch a partial request once it can no longer grow. */
+static int conn_buf_full(const connection_t *conn)
+{
+    return conn->buf != NULL && conn->len == conn->cap && conn->cap + 1 >= CONN_BUFFER_MAX;
+}
+
+connection_t *event_loop_conn(int fd)
+{
+    if (fd < 0 || (size_t)fd >= g_conns_size) return NULL;
+
+    connection_t *conn = g_conns[fd];
+    if (conn != NULL)
+        admission_dequeued(&conn->loop->admission, conn->queued_ns);
+    return conn;
+}
+
+static connection_t *conn_create(event_loop_t *loop, int fd)
+{
+    if ((size_t)fd >= g_conns_size ||
+        __atomic_load_n(&g_conns_live, __ATOMIC_RELAXED) >= N_CONNECTIONS)
+        return NULL;
+
+    /* The receive buffer is attached on the first read (conn_buf_reserve). */
+    connection_t *conn = calloc(1, sizeof(connection_t));
+    if (conn == NULL) return NULL;
+
+    conn->fd   = fd;
+    conn->loop = loop;
+    http_parser_init(&conn->parser);
+    if (access_log_enabled() || metrics_enabled()) conn->accept_ns = monotonic_ns();
+
+    g_conns[fd] = conn;
+    __atomic_add_fetch(&g_conns_live, 1, __ATOMIC_RELAXED);
+    return conn;
+}
+
+void event_loop_close(connection_t *conn)
+{
+    int fd = conn->fd;
+
+    /* Clear the slot before close(): once the fd is released another
+       acceptor may be handed the same number. */
+    g_conns[fd] = NULL;
+    __atomic_sub_fetch(&g_conns_live, 1, __ATOMIC_RELAXED);
+
+    conn_buf_release(conn);
+    arena_free(&conn->arena);
+    free(conn);
+    close(fd);          /* also drops it from the epoll set */
+}
+
+size_t event_loop_connections(void)
+{
+    return __atomic_load_n(&g_conns_live, __ATOMIC_RELAXED);
+}
+
+void event_loop_rearm(connection_t *conn)
+{
+    event_loop_t *loop = conn->loop;
+
+    /* Idle keep-alive connections hold no buffer at all. */
+    if (conn->len == 0)
+        conn_buf_release(conn);
+
+    if (loop->backend == IO_BACKEND_URING)
+    {
+        pthread_mutex_lock(&loop->rearm_lock);
+        conn->next       = loop->rearm_list;
+        loop->rearm_list = conn;
+        pthread_mutex_unlock(&loop->rearm_lock);
+
+        uint64_t one = 1;
+        if (write(loop->wake_fd, &one, sizeof(one)) < 0)
+            log_write(LOG_ERROR, "eventfd write failed: %s\n", strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev = { .events = CONN_EVENTS, .data.ptr = conn };
+
+    /* EPOLL_CTL_MOD re-polls the socket, so bytes that arrived while a
+       worker owned the connection still raise an event. */
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0)
+    {
+        log_write(LOG_ERROR, "epoll_ctl(MOD) failed: %s\n", strerror(errno));
+        event_loop_close(conn);
+    }
+}
+
+/* Feed the bytes received since the last call to the parser. Returns 1 once
+   a worker has something to answer: a whole request, a malformed one (400),
+   or one that cannot fit in the largest buffer (413). */
+static int conn_ready(connection_t *conn)
+{
+    if (conn->buf == NULL) return 0;
+
+    if (http_parser_execute(&conn->parser, conn->buf, conn->len) != HTTP_PARSE_NEED_MORE)
+        return 1;
+    if (conn_buf_full(conn))
+        return 1;
+
+    /* A large body is not buffered: once the head is in, the worker either
+       streams it from the socket (uploads) or answers 413 straight away. A
+       chunked body shows its size only as it arrives. */
+    const http_request_t *req = &conn->parser.req;
+    return http_parser_head_done(&conn->parser) &&
+           (req->content_length > CONN_STREAM_BODY ||
+            req->head_len + req->content_length > CONN_BUFFER_MAX - 1 ||
+            (req->chunked && req->body.len > CONN_STREAM_BODY));
+}
+
+/* Bytes for a request arrived: start its clock if they are its first. */
+static inline void conn_first_byte(connection_t *conn)
+{
+    if (conn->first_byte_ns == 0 && conn->accept_ns != 0)
+        conn->first_byte_ns = monotonic_ns();
+}
+
+/* The access log and the metrics see shed requests too: they are what the
+   p99 hides. */
+static void record_shed(const connection_t *conn, uint64_t now, size_t bytes)
+{
+    access_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    const http_request_t *req = &conn->parser.req;
+    record.accept_ns     = conn->accept_ns;
+    record.first_byte_ns = conn->first_byte_ns;
+    record.dispatched_ns = now;
+    record.last_byte_ns  = monotonic_ns();
+    record.bytes_sent    = bytes;
+    record.resource_id   = -1;
+    record.status        = Service_Unavailable;
+    record.method        = http_parser_head_done(&conn->parser) ? req->method_code : METHOD_COUNT;
+    if (http_parser_head_done(&conn->parser))
+        access_record_set_target(&record, conn->buf + req->target.off, req->target.len);
+    if (access_log_enabled()) access_log_write(&record);
+    metrics_record(-1, record.method, record.status, conn->len, bytes,
+                   (record.first_byte_ns != 0) ? record.last_byte_ns - record.first_byte_ns : 0);
+}
+
+/* Bytes were appended to conn->buf on the reactor thread: hand the request
+   to the pool once conn_ready() says so, else wait for more. A dispatch the
+   pool cannot take in time gets a 503 with Retry-After rather than a bare
+   close, which clients would answer with an immediate retry. */
+static void conn_continue(event_loop_t *loop, connection_t *conn)
+{
+    if (conn_ready(conn))
+    {
+        uint64_t now = admission_now();
+        int full = 0;
+        if (admission_admit(&loop->admission, now))
+        {
+            conn->queued_ns = now;
+            if (thread_pool_submit(loop->pool, conn->fd) == 0) return;
+            full = 1;
+            log_write(LOG_INFO, "Pool full, shedding connection\n");
+        }
+        else
+            log_write(LOG_DEBUG, "Queue delay above target, shedding connection\n");
+
+        admission_reject(&loop->admission, conn->fd, full);
+        if (conn->accept_ns != 0) record_shed(conn, now, loop->admission.reply_len);
+        event_loop_close(conn);
+        return;
+    }
+
+    if (loop->backend == IO_BACKEND_URING)
+        uring_queue_recv(loop, conn);
+    else
+        event_loop_rearm(conn);
+}
+
+/* Peer closed: dispatch what is buffered if there is something to answer.
+   Returns 1 if the connection was closed. */
+static int conn_eof(connection_t *conn)
+{
+    if (!conn_ready(conn))
+    {
+        log_write(LOG_DEBUG, "Closing connection as requested\n");
+        event_loop_close(conn);
+        return 1;
+    }
+    conn->peer_closed = 1;
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*                io_uring backend              */
+/*----------------------------------------------*/
+
+static struct io_uring_sqe *loop_sqe(event_loop_t *loop)
+{
+    struct io_uring_sqe *sqe;
+    while ((sqe = uring_get_sqe(loop->ring)) == NULL)
+        uring_submit(loop->ring, 0);
+    return sqe;
+}
+
+static void uring_queue_accept(event_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = loop_sqe(loop);
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = loop->listen_fd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;   /* the workers' sends time out on EAGAIN */
+    sqe->user_data    = TAG_ACCEPT;
+}
+
+static void uring_queue_wake(event_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = loop_sqe(loop);
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = loop->wake_fd;
+    sqe->addr      = (uint64_t)(uintptr_t)&loop->wake_buf;
+    sqe->len       = sizeof(loop->wake_buf);
+    sqe->user_data = TAG_WAKE;
+}
+
+static void uring_queue_recv(event_loop_t *loop, connection_t *conn)
+{
+    /* The bytes land in a provided buffer; the connection buffer is only
+       needed, and attached, when they are copied out. */
+    if (conn->buf != NULL && conn_buf_reserve(conn) != 1)
+    {
+        event_loop_close(conn);
+        return;
+    }
+    size_t room = (conn->buf != NULL) ? conn->cap - conn->len : CONN_BUFFER_INITIAL - 1;
+
+    struct io_uring_sqe *sqe = loop_sqe(loop);
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = conn->fd;
+    sqe->len       = (unsigned)((room < URING_BUF_SIZE) ? room : URING_BUF_SIZE);
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)conn;
+}
+
+static int uring_loop_init(event_loop_t *loop)
+{
+    loop->ring = malloc(sizeof(uring_t));
+    loop->bufs = malloc(sizeof(uring_buf_ring_t));
+    if (loop->ring == NULL || loop->bufs == NULL) goto fail;
+
+    if (uring_init(loop->ring, URING_ENTRIES) != 0) goto fail;
+    if (uring_buf_ring_init(loop->ring, loop->bufs) != 0) goto fail_ring;
+
+    loop->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (loop->wake_fd < 0) goto fail_ring;
+
+    pthread_mutex_init(&loop->rearm_lock, NULL);
+    loop->rearm_list = NULL;
+
+    uring_queue_accept(loop);
+    uring_queue_wake(loop);
+    return 0;
+
+fail_ring:
+    uring_exit(loop->ring);
+fail:
+    free(loop->ring);
+    free(loop->bufs);
+    return -1;
+}
+
+static void uring_on_accept(event_loop_t *loop, int res, unsigned flags)
+{
+    if (!(flags & IORING_CQE_F_MORE))
+        uring_queue_accept(loop);
+
+    if (res < 0)
+    {
+        if (res != -EAGAIN && res != -EINTR)
+            log_write(LOG_ERROR, "accept failed: %s\n", strerror(-res));
+        return;
+    }
+
+    connection_t *conn = conn_create(loop, res);
+    if (conn == NULL)
+    {
+        log_write(LOG_INFO, "Connection limit reached, dropping connection\n");
+        close(res);
+        return;
+    }
+    uring_queue_recv(loop, conn);
+}
+
+static void uring_on_wake(event_loop_t *loop)
+{
+    pthread_mutex_lock(&loop->rearm_lock);
+    connection_t *conn = loop->rearm_list;
+    loop->rearm_list = NULL;
+    pthread_mutex_unlock(&loop->rearm_lock);
+
+    while (conn != NULL)
+    {
+        connection_t *next = conn->next;
+        uring_queue_recv(loop, conn);
+        conn = next;
+    }
+    uring_queue_wake(loop);
+}
+
+static void uring_on_recv(event_loop_t *loop, connection_t *conn, int res, unsigned flags)
+{
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        int room = (res <= 0) || (conn_buf_reserve(conn) == 1);
+        if (res > 0 && room)
+            memcpy(conn->buf + conn->len, uring_buf_ring_get(loop->bufs, bid), (size_t)res);
+        uring_buf_ring_recycle(loop->bufs, bid);
+
+        if (!room)
+        {
+            event_loop_close(conn);
+            return;
+        }
+    }
+
+    if (res > 0)
+    {
+        conn_first_byte(conn);
+        conn->len += (size_t)res;
+        conn_continue(loop, conn);
+    }
+    else if (res == 0)
+    {
+        if (!conn_eof(conn)) conn_continue(loop, conn);
+    }
+    else if (res == -ENOBUFS || res == -EINTR || res == -EAGAIN)
+    {
+        uring_queue_recv(loop, conn);
+    }
+    else
+    {
+        log_write(LOG_DEBUG, "Error on recv\n");
+        event_loop_close(conn);
+    }
+}
+
+static void uring_loop_run(event_loop_t *loop)
+{
+    for (;;)
+    {
+        int ret = uring_submit(loop->ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY)
+        {
+            log_write(LOG_ERROR, "io_uring_enter failed: %s\n", strerror(-ret));
+            return;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(loop->ring)) != NULL)
+        {
+            uint64_t data  = cqe->user_data;
+            int      res   = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(loop->ring);
+
+            if (data == TAG_ACCEPT)     uring_on_accept(loop, res, flags);
+            else if (data == TAG_WAKE)  uring_on_wake(loop);
+            else                        uring_on_recv(loop, (connection_t *)(uintptr_t)data, res, flags);
+        }
+    }
+}
+
+int event_loop_init(event_loop_t *loop, int listen_fd, thread_pool_t *pool)
+{
+    if (loop == NULL || pool == NULL) return -1;
+    if (conn_table_init() != 0) return -1;
+
+    loop->backend   = g_io_backend;
+    loop->listen_fd = listen_fd;
+    loop->pool      = pool;
+    loop->epoll_fd  = -1;
+
+    if (loop->backend == IO_BACKEND_URING)
+        return uring_loop_init(loop);
+
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) != 0) return -1;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) return -1;
+
+    /* data.ptr == NULL marks the listening socket. */
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0)
+    {
+        close(loop->epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*                 epoll backend                */
+/*----------------------------------------------*/
+
+static void on_accept(event_loop_t *loop)
+{
+    for (;;)
+    {
+        int client_fd = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                log_write(LOG_ERROR, "accept failed: %s\n", strerror(errno));
+            return;
+        }
+
+        connection_t *conn = conn_create(loop, client_fd);
+        if (conn == NULL)
+        {
+            log_write(LOG_INFO, "Connection limit reached, dropping connection\n");
+            close(client_fd);
+            continue;
+        }
+
+        struct epoll_event ev = { .events = CONN_EVENTS, .data.ptr = conn };
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) != 0)
+        {
+            log_write(LOG_ERROR, "epoll_ctl(ADD) failed: %s\n", strerror(errno));
+            event_loop_close(conn);
+        }
+    }
+}
+
+/* Drain the socket (edge-triggered: until EAGAIN), then either hand a
+   complete request to the pool or re-arm and wait for more bytes. */
+static void on_readable(event_loop_t *loop, connection_t *conn)
+{
+    for (;;)
+    {
+        int room = conn_buf_reserve(conn);
+        if (room == 0) break;
+        if (room < 0)
+        {
+            log_write(LOG_ERROR, "Out of buffer memory, dropping connection\n");
+            event_loop_close(conn);
+            return;
+        }
+
+        ssize_t n = recv(conn->fd, conn->buf + conn->len, conn->cap - conn->len, 0);
+        if (n > 0)
+        {
+            conn_first_byte(conn);
+            conn->len += (size_t)n;
+            continue;
+        }
+        if (n == 0)
+        {
+            if (conn_eof(conn)) return;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+        log_write(LOG_DEBUG, "Error on recv\n");
+        event_loop_close(conn);
+        return;
+    }
+
+    conn_continue(loop, conn);
+}
+
+static void epoll_loop_run(event_loop_t *loop)
+{
+    struct epoll_event events[EVENT_BATCH];
+
+    for (;;)
+    {
+        int n = epoll_wait(loop->epoll_fd, events, EVENT_BATCH, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            log_write(LOG_ERROR, "epoll_wait failed: %s\n", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            connection_t *conn = events[i].data.ptr;
+            if (conn == NULL)
+            {
+                on_accept(loop);
+                continue;
+            }
+
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+            {
+                event_loop_close(conn);
+                continue;
+            }
+            on_readable(loop, conn);
+        }
+    }
+}
+
+void event_loop_run(event_loop_t *loop)
+{
+    if (loop->backend == IO_BACKEND_URING)
+        uring_loop_run(loop);
+    else
+        epoll_loop_run(loop);
+}
@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/file_cache.h"
+#include "../include/hash.h"
+#include "../include/utils.h"
+
+void file_cache_init(file_cache_t *cache, size_t max_bytes, size_t max_entries, size_t max_file)
+{
+    memset(cache, 0, sizeof(*cache));
+    pthread_rwlock_init(&cache->lock, NULL);
+    if (max_bytes == 0 || max_entries == 0) return;
+
+    unsigned int buckets = 16;
+    while (buckets < 2 * max_entries) buckets <<= 1;
+
+    cache->buckets = calloc(buckets, sizeof(file_cache_entry_t *));
+    cache->ring    = calloc(max_entries, sizeof(file_cache_entry_t *));
+    if (cache->buckets == NULL || cache->ring == NULL)
+    {
+        free(cache->buckets);
+        free(cache->ring);
+        cache->buckets = NULL;
+        cache->ring    = NULL;
+        return;
+    }
+
+    cache->bucket_count = buckets;
+    cache->ring_size    = max_entries;
+    cache->max_bytes    = max_bytes;
+    cache->max_file     = (max_file < max_bytes) ? max_file : max_bytes;
+}
+
+int file_cache_accepts(const file_cache_t *cache, size_t size)
+{
+    return cache->ring != NULL && size <= cache->max_file;
+}
+
+void file_cache_release(file_cache_entry_t *entry)
+{
+    if (entry != NULL && __atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(entry);
+}
+
+/* Called with the lock held exclusively. Drops the table's reference. */
+static void unlink_entry(file_cache_t *cache, file_cache_entry_t *entry)
+{
+    file_cache_entry_t **pp = &cache->buckets[hash_index(entry->key, (int)cache->bucket_count)];
+    while (*pp != entry) pp = &(*pp)->hash_next;
+    *pp = entry->hash_next;
+
+    cache->ring[entry->slot] = NULL;
+    cache->entries--;
+    cache->bytes -= entry->charge;
+    file_cache_release(entry);
+}
+
+static file_cache_entry_t *find(const file_cache_t *cache, const char *key)
+{
+    file_cache_entry_t *e = cache->buckets[hash_index(key, (int)cache->bucket_count)];
+    while (e != NULL && strcmp(e->key, key) != 0) e = e->hash_next;
+    return e;
+}
+
+/* Second-chance sweep: clear referenced bits until an unreferenced entry
+   comes under the hand. Called with the lock held exclusively and at
+   least one entry present. */
+static void evict_one(file_cache_t *cache)
+{
+    for (;;)
+    {
+        file_cache_entry_t *e = cache->ring[cache->hand];
+        cache->hand = (cache->hand + 1) % cache->ring_size;
+        if (e == NULL) continue;
+
+        if (__atomic_exchange_n(&e->referenced, 0, __ATOMIC_RELAXED)) continue;
+
+        unlink_entry(cache, e);
+        cache->evictions++;
+        return;
+    }
+}
+
+file_cache_entry_t *file_cache_get(file_cache_t *cache, const char *key)
+{
+    if (cache->ring == NULL) return NULL;
+
+    pthread_rwlock_rdlock(&cache->lock);
+    file_cache_entry_t *e = find(cache, key);
+    if (e != NULL)
+    {
+        __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&e->referenced, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&cache->lock);
+    return e;
+}
+
+/* One allocation: entry, key, body, then both heads. The body is left for
+   the caller to fill. */
+static file_cache_entry_t *entry_new(const file_cache_t *cache, const char *key, const file_ident_t *ident,
+                                     size_t body_len,
+                                     const char *head_close, size_t head_close_len,
+                                     const char *head_keep,  size_t head_keep_len)
+{
+    if (!file_cache_accepts(cache, body_len)) return NULL;
+
+    size_t key_len = strlen(key);
+    size_t charge  = sizeof(file_cache_entry_t) + key_len + 1 + body_len + head_close_len + head_keep_len;
+    if (charge > cache->max_bytes) return NULL;
+
+    file_cache_entry_t *e = malloc(charge);
+    if (e == NULL) return NULL;
+
+    char *p = (char *)(e + 1);
+    e->key = p;
+    memcpy(p, key, key_len + 1);                    p += key_len + 1;
+    e->body = p;                                    p += body_len;
+    e->head[0] = p;
+    memcpy(p, head_close, head_close_len);          p += head_close_len;
+    e->head[1] = p;
+    memcpy(p, head_keep, head_keep_len);
+    e->body_len    = body_len;
+    e->head_len[0] = head_close_len;
+    e->head_len[1] = head_keep_len;
+    e->ident       = *ident;
+    e->charge      = charge;
+    e->refs        = 2;                             /* table + caller */
+    e->referenced  = 0;
+    e->hash_next   = NULL;
+    return e;
+}
+
+static file_cache_entry_t *publish(file_cache_t *cache, file_cache_entry_t *e)
+{
+    pthread_rwlock_wrlock(&cache->lock);
+
+    file_cache_entry_t *old = find(cache, e->key);
+    if (old != NULL) unlink_entry(cache, old);
+
+    while (cache->entries > 0 &&
+           (cache->entries == cache->ring_size || cache->bytes + e->charge > cache->max_bytes))
+        evict_one(cache);
+
+    /* Some slot is free now that entries < ring_size. */
+    while (cache->ring[cache->hand] != NULL)
+        cache->hand = (cache->hand + 1) % cache->ring_size;
+    e->slot = (uint32_t)cache->hand;
+    cache->ring[cache->hand] = e;
+
+    file_cache_entry_t **bucket = &cache->buckets[hash_index(e->key, (int)cache->bucket_count)];
+    e->hash_next = *bucket;
+    *bucket      = e;
+
+    cache->entries++;
+    cache->bytes += e->charge;
+    cache->inserts++;
+
+    pthread_rwlock_unlock(&cache->lock);
+    return e;
+}
+
+file_cache_entry_t *file_cache_insert(file_cache_t *cache, const char *key, const file_ident_t *ident,
+                                      int file_fd, size_t body_len,
+                                      const char *head_close, size_t head_close_len,
+                                      const char *head_keep,  size_t head_keep_len)
+{
+    file_cache_entry_t *e = entry_new(cache, key, ident, body_len,
+                                      head_close, head_close_len, head_keep, head_keep_len);
+    if (e == NULL) return NULL;
+
+    if (pread_all(file_fd, (char *)e->body, body_len, 0) != 0)
+    {
+        free(e);
+        return NULL;
+    }
+    return publish(cache, e);
+}
+
+file_cache_entry_t *file_cache_insert_mem(file_cache_t *cache, const char *key, const file_ident_t *ident,
+                                          const char *body, size_t body_len,
+                                          const char *head_close, size_t head_close_len,
+                                          const char *head_keep,  size_t head_keep_len)
+{
+    file_cache_entry_t *e = entry_new(cache, key, ident, body_len,
+                                      head_close, head_close_len, head_keep, head_keep_len);
+    if (e == NULL) return NULL;
+
+    memcpy((char *)e->body, body, body_len);
+    return publish(cache, e);
+}
+
+void file_cache_invalidate(file_cache_t *cache, const char *key)
+{
+    if (cache->ring == NULL) return;
+
+    pthread_rwlock_wrlock(&cache->lock);
+    file_cache_entry_t *e = find(cache, key);
+    if (e != NULL)
+    {
+        unlink_entry(cache, e);
+        cache->invalidations++;
+    }
+    pthread_rwlock_unlock(&cache->lock);
+}
+
+void file_cache_get_stats(file_cache_t *cache, file_cache_stats_t *stats)
+{
+    pthread_rwlock_rdlock(&cache->lock);
+    stats->hits          = __atomic_load_n(&cache->hits,   __ATOMIC_RELAXED);
+    stats->misses        = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+    stats->inserts       = cache->inserts;
+    stats->evictions     = cache->evictions;
+    stats->invalidations = cache->invalidations;
+    stats->entries       = cache->entries;
+    stats->bytes         = cache->bytes;
+    pthread_rwlock_unlock(&cache->lock);
+}
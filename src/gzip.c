@@ -0,0 +1,103 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include "../include/gzip.h"
+#include "../include/utils.h"
+
+#define GZIP_STREAM_BUF (64u << 10)
+
+int gzip_compressible(content_type_t type)
+{
+    switch (type)
+    {
+    case HTML:
+    case TEXT:
+    case JS:
+    case CSS:
+    case JSON:
+    case SVG:
+    case WASM:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int gzip_compress(const char *src, size_t length, int level, char **out, size_t *out_length)
+{
+    if (length > UINT_MAX) return -1;
+
+    z_stream zs = { 0 };
+    /* windowBits 15 + 16: gzip header and trailer instead of zlib's. */
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    uLong bound = deflateBound(&zs, (uLong)length);
+    char *buf = malloc(bound);
+    if (buf == NULL) { deflateEnd(&zs); return -1; }
+
+    zs.next_in   = (Bytef *)src;
+    zs.avail_in  = (uInt)length;
+    zs.next_out  = (Bytef *)buf;
+    zs.avail_out = (uInt)bound;
+
+    /* The output buffer is deflateBound() sized: one call finishes. */
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+    {
+        deflateEnd(&zs);
+        free(buf);
+        return -1;
+    }
+
+    *out        = buf;
+    *out_length = zs.total_out;
+    deflateEnd(&zs);
+    return 0;
+}
+
+int gzip_compress_file(int file_fd, uint64_t size, int level, gzip_sink_t sink, void *ctx)
+{
+    z_stream zs = { 0 };
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    char *in  = malloc(GZIP_STREAM_BUF);
+    char *out = malloc(GZIP_STREAM_BUF);
+    int   rc  = (in != NULL && out != NULL) ? 0 : -1;
+
+    zs.next_out  = (Bytef *)out;
+    zs.avail_out = GZIP_STREAM_BUF;
+
+    uint64_t offset = 0;
+    int      flush  = Z_NO_FLUSH;
+    while (rc == 0)
+    {
+        if (zs.avail_in == 0 && flush == Z_NO_FLUSH)
+        {
+            size_t len = (size - offset < GZIP_STREAM_BUF) ? (size_t)(size - offset) : GZIP_STREAM_BUF;
+            if (pread_all(file_fd, in, len, (off_t)offset) != 0) { rc = -1; break; }
+            offset      += len;
+            zs.next_in   = (Bytef *)in;
+            zs.avail_in  = (uInt)len;
+            if (offset == size) flush = Z_FINISH;
+        }
+
+        int z = deflate(&zs, flush);
+        if (z == Z_STREAM_ERROR) { rc = -1; break; }
+
+        /* Hand the buffer on when full, and whatever is left at the end. */
+        if (zs.avail_out == 0 || z == Z_STREAM_END)
+        {
+            size_t have = GZIP_STREAM_BUF - zs.avail_out;
+            if (have > 0 && sink(ctx, out, have) != 0) { rc = -1; break; }
+            zs.next_out  = (Bytef *)out;
+            zs.avail_out = GZIP_STREAM_BUF;
+        }
+        if (z == Z_STREAM_END) break;
+    }
+
+    deflateEnd(&zs);
+    free(in);
+    free(out);
+    return rc;
+}
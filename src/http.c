@@ -1,4 +1,11 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "../include/http.h"
+#include "../include/phash.h"
+#include "../include/scan.h"
+#include "../bin/gen/http_phash.h"     /* generated by tools/gen_phash.c */
 
 const char *MimeType[MAX_EXTENSION] = 
 {
@@ -22,6 +29,33 @@ const http_error_t http_errors[] = {HTTP_ERRORS};
 const char * const http_methods_name[METHOD_COUNT] = {HTTP_METHODS};
 #undef X
 
+#define X(id, name) [id] = name,
+const char *known_headers[HDR_UNKNOWN] = {HTTP_HEADERS};
+#undef X
+
+header_id http_header_lookup(const char *name, size_t length)
+{
+    /* Anything longer than the longest listed name cannot be one. */
+    char lower[PHASH_HEADER_MAXLEN];
+    if (length == 0 || length > sizeof(lower)) return HDR_UNKNOWN;
+    g_scan.lower(lower, name, length);
+
+    const phash_slot_t *slot = phash_find(phash_header, PHASH_HEADER_MASK, PHASH_HEADER_SEED, lower, length);
+    return (slot != NULL) ? (header_id)slot->value : HDR_UNKNOWN;
+}
+
+http_methods_code http_method_lookup(const char *name, size_t length)
+{
+    const phash_slot_t *slot = phash_find(phash_method, PHASH_METHOD_MASK, PHASH_METHOD_SEED, name, length);
+    return (slot != NULL) ? (http_methods_code)slot->value : METHOD_COUNT;
+}
+
+content_type_t http_extension_lookup(const char *ext, size_t length)
+{
+    const phash_slot_t *slot = phash_find(phash_extension, PHASH_EXTENSION_MASK, PHASH_EXTENSION_SEED, ext, length);
+    return (slot != NULL) ? (content_type_t)slot->value : MAX_EXTENSION;
+}
+
 const char *get_http_error_name(int code)
 {
     switch (code) {
@@ -30,4 +64,46 @@ const char *get_http_error_name(int code)
 #undef X
         default: return "UNKNOWN_ERROR";
     }
-}
\ No newline at end of file
+}
+
+int http_date_parse(const char *value, size_t length, time_t *out)
+{
+    static const char *const formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",        /* Sun, 06 Nov 1994 08:49:37 GMT */
+        "%A, %d-%b-%y %H:%M:%S GMT",        /* Sunday, 06-Nov-94 08:49:37 GMT */
+        "%a %b %d %H:%M:%S %Y",             /* Sun Nov  6 08:49:37 1994 */
+    };
+
+    char buf[64];
+    while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t')) length--;
+    if (length >= sizeof(buf)) return -1;
+    memcpy(buf, value, length);
+    buf[length] = '\0';
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *rest = strptime(buf, formats[i], &tm);
+        if (rest == NULL || *rest != '\0') continue;
+
+        *out = timegm(&tm);
+        return 0;
+    }
+    return -1;
+}
+
+int http_date_format(char *buf, size_t size, time_t t)
+{
+    /* strftime's %a and %b follow the locale; these must not. */
+    static const char days[7][4]    = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    struct tm tm;
+    if (gmtime_r(&t, &tm) == NULL) return -1;
+
+    int n = snprintf(buf, size, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                     days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
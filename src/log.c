@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "../include/log.h"
+
+#define LOG_BATCH_IOV   256     /* iovecs per writev(); two per ring at most */
+
+log_level_t g_log_level = LOG_ERROR;
+FILE       *g_log_file  = NULL;
+
+/* One thread's pending messages, as a byte ring. The owning thread is the
+   only producer; whoever holds g_drain_lock is the only consumer. A ring
+   outlives its thread and is taken over by the next new one. */
+typedef struct log_ring_s
+{
+    /* Owner only. */
+    uint64_t           head;            /* bytes ever queued */
+    uint64_t           written;
+    uint64_t           dropped;
+    time_t             ts_sec;          /* the second `ts` was formatted for */
+    char               ts[20];
+
+    char               pad[64];
+    uint64_t           tail;            /* bytes ever drained */
+    uint64_t           dropped_seen;    /* by the flusher, for its report */
+
+    uint32_t           owned;
+    struct log_ring_s *next;            /* registry; rings are never freed */
+    char               data[LOG_RING_SIZE];
+} log_ring_t;
+
+static log_ring_t      *g_rings = NULL;
+static __thread log_ring_t *tls_ring;
+static pthread_key_t    g_ring_key;
+static pthread_once_t   g_ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  g_drain_lock    = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t         g_running       = 0;
+static uint32_t         g_wake          = 0;   /* futex word: 1 once a ring is half full */
+static uint64_t         g_lost          = 0;   /* messages from threads with no ring */
+
+static const char *level_str[] = { "ERROR", "INFO ", "DEBUG" };
+
+static void ring_release(void *arg)
+{
+    __atomic_store_n(&((log_ring_t *)arg)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void ring_key_init(void)
+{
+    pthread_key_create(&g_ring_key, ring_release);
+}
+
+/* The calling thread's ring: one a finished thread left behind, or a new
+   one. NULL if out of memory. */
+static log_ring_t *ring_get(void)
+{
+    if (tls_ring != NULL) return tls_ring;
+    pthread_once(&g_ring_key_once, ring_key_init);
+
+    log_ring_t *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+    for (; ring != NULL; ring = ring->next)
+    {
+        uint32_t free_ring = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &free_ring, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if (ring == NULL)
+    {
+        ring = calloc(1, sizeof(log_ring_t));
+        if (ring == NULL) return NULL;
+        ring->owned = 1;
+        ring->next  = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    tls_ring = ring;
+    pthread_setspecific(g_ring_key, ring);
+    return ring;
+}
+
+static void format_ts(time_t sec, char *ts, size_t size)
+{
+    struct tm tm_buf;
+    localtime_r(&sec, &tm_buf);
+    strftime(ts, size, "%Y-%m-%d %H:%M:%S", &tm_buf);
+}
+
+static void futex_wait(uint32_t *addr, uint32_t expected, unsigned timeout_ms)
+{
+    struct timespec timeout = { .tv_sec  = timeout_ms / 1000,
+                                .tv_nsec = (long)(timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* writev() every iovec, consuming `iov`. Log output is best-effort: an
+   error drops the rest of the batch. */
+static void writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+}
+
+static void output(struct iovec *iov, int iovcnt)
+{
+    struct iovec copy[LOG_BATCH_IOV + 1];
+    int          fds[2] = { STDOUT_FILENO, (g_log_file != NULL) ? fileno(g_log_file) : -1 };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i] < 0) continue;
+        memcpy(copy, iov, (size_t)iovcnt * sizeof(struct iovec));
+        writev_all(fds[i], copy, iovcnt);
+    }
+}
+
+void log_emit(log_level_t level, const char *fmt, ...)
+{
+    log_ring_t *ring = ring_get();
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+    /* localtime_r() and strftime() once a second per thread, not per line. */
+    char        ts_local[20];
+    const char *ts = ts_local;
+    if (ring != NULL)
+    {
+        if (ring->ts_sec != now.tv_sec || ring->ts[0] == '\0')
+        {
+            format_ts(now.tv_sec, ring->ts, sizeof(ring->ts));
+            ring->ts_sec = now.tv_sec;
+        }
+        ts = ring->ts;
+    }
+    else
+        format_ts(now.tv_sec, ts_local, sizeof(ts_local));
+
+    char line[LOG_LINE_MAX];
+    int  n = snprintf(line, sizeof(line), "[%s] [%s] ", ts, level_str[level]);
+
+    va_list ap;
+    va_start(ap, fmt);
+    int m = vsnprintf(line + n, sizeof(line) - (size_t)n, fmt, ap);
+    va_end(ap);
+    if (m < 0) return;
+
+    size_t len = (size_t)n + (size_t)m;
+    if (len >= sizeof(line)) len = sizeof(line) - 1;
+
+    if (!__atomic_load_n(&g_running, __ATOMIC_ACQUIRE))
+    {
+        struct iovec iov = { line, len };
+        output(&iov, 1);
+        return;
+    }
+    if (ring == NULL)
+    {
+        __atomic_add_fetch(&g_lost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t head = ring->head;
+    uint64_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (LOG_RING_SIZE - used < len)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    size_t off   = (size_t)(head % LOG_RING_SIZE);
+    size_t first = (len < LOG_RING_SIZE - off) ? len : LOG_RING_SIZE - off;
+    memcpy(ring->data + off, line, first);
+    memcpy(ring->data, line + first, len - first);
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->written, ring->written + 1, __ATOMIC_RELAXED);
+
+    /* Past half full, get the flusher going now rather than drop later. */
+    if (used + len > LOG_RING_SIZE / 2 && !__atomic_exchange_n(&g_wake, 1, __ATOMIC_RELAXED))
+        futex_wake(&g_wake);
+}
+
+/* Append [tail, head) of a ring to the batch: two iovecs if it wraps. */
+static int ring_iov(log_ring_t *ring, uint64_t head, struct iovec *iov)
+{
+    size_t off = (size_t)(ring->tail % LOG_RING_SIZE);
+    size_t len = (size_t)(head - ring->tail);
+    size_t first = (len < LOG_RING_SIZE - off) ? len : LOG_RING_SIZE - off;
+
+    iov[0].iov_base = ring->data + off;
+    iov[0].iov_len  = first;
+    if (first == len) return 1;
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len  = len - first;
+    return 2;
+}
+
+void log_flush(void)
+{
+    struct iovec iov[LOG_BATCH_IOV + 1];
+    log_ring_t  *batch[LOG_BATCH_IOV / 2];
+    uint64_t     heads[LOG_BATCH_IOV / 2];
+    uint64_t     dropped = 0;
+
+    pthread_mutex_lock(&g_drain_lock);
+
+    log_ring_t *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+    while (ring != NULL)
+    {
+        int iovcnt = 0, rings = 0;
+        for (; ring != NULL && rings < LOG_BATCH_IOV / 2; ring = ring->next)
+        {
+            uint64_t d = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+            dropped += d - ring->dropped_seen;
+            ring->dropped_seen = d;
+
+            uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            if (head == ring->tail) continue;
+
+            iovcnt += ring_iov(ring, head, iov + iovcnt);
+            batch[rings] = ring;
+            heads[rings] = head;
+            rings++;
+        }
+        if (iovcnt == 0) continue;
+
+        output(iov, iovcnt);
+        for (int i = 0; i < rings; i++)
+            __atomic_store_n(&batch[i]->tail, heads[i], __ATOMIC_RELEASE);
+    }
+
+    if (dropped > 0)
+    {
+        char ts[20], line[96];
+        format_ts(time(NULL), ts, sizeof(ts));
+        int n = snprintf(line, sizeof(line), "[%s] [%s] Log buffer full, dropped %llu messages\n",
+                         ts, level_str[LOG_ERROR], (unsigned long long)dropped);
+        struct iovec note = { line, (size_t)n };
+        output(&note, 1);
+    }
+
+    pthread_mutex_unlock(&g_drain_lock);
+}
+
+static void *flusher_main(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        __atomic_store_n(&g_wake, 0, __ATOMIC_RELAXED);
+        log_flush();
+        futex_wait(&g_wake, 0, LOG_FLUSH_MS);
+    }
+    return NULL;
+}
+
+int log_start(void)
+{
+    pthread_t      thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    int rc = pthread_create(&thread, &attr, flusher_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) return -1;
+
+    atexit(log_flush);
+    __atomic_store_n(&g_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void log_get_stats(log_stats_t *stats)
+{
+    stats->written = 0;
+    stats->dropped = __atomic_load_n(&g_lost, __ATOMIC_RELAXED);
+    for (log_ring_t *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+    {
+        stats->written += __atomic_load_n(&ring->written, __ATOMIC_RELAXED);
+        stats->dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+}
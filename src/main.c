@@ -1,52 +1,71 @@
+#define _GNU_SOURCE
 #include <errno.h>
-#include <stdarg.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
+#include <sched.h>
+#include <linux/filter.h>
+#include "../include/access_log.h"
+#include "../include/admission.h"
+#include "../include/event_loop.h"
+#include "../include/file_cache.h"
+#include "../include/gzip.h"
+#include "../include/log.h"
+#include "../include/metrics.h"
+#include "../include/scan.h"
 #include "../include/server.h"
 #include "../include/thread_pool.h"
-
-#define WORKER_COUNT     16
-#define QUEUE_CAPACITY   64
-
-log_level_t  g_log_level = LOG_ERROR;
-FILE        *g_log_file  = NULL;
-static pthread_mutex_t g_log_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-void log_write(log_level_t level, const char *fmt, ...)
+#include "../include/uring.h"
+
+#define PIPELINE_SLICE  16      /* pipelined requests answered per pool task */
+
+io_backend_t g_io_backend = IO_BACKEND_EPOLL;
+
+typedef enum {
+    STEER_NONE = 0,
+    STEER_INCOMING_CPU,     /* SO_INCOMING_CPU hint on each listener */
+    STEER_BPF               /* reuseport CBPF: pick the listener by cpu */
+} steering_t;
+
+static int        g_shard_count    = 0;     /* 0 = one listener, no pinning */
+static steering_t g_shard_steering = STEER_NONE;
+static int        g_scan_force     = -1;    /* simd = ...; -1 = best available */
+static size_t     g_cache_bytes    = FILE_CACHE_DEFAULT_BYTES;
+static size_t     g_cache_entries  = FILE_CACHE_DEFAULT_ENTRIES;
+static size_t     g_cache_max_file = FILE_CACHE_DEFAULT_MAX_FILE;
+static size_t     g_gzip_bytes     = GZIP_DEFAULT_CACHE_BYTES;
+static size_t     g_gzip_entries   = GZIP_DEFAULT_CACHE_ENTRIES;
+static size_t     g_gzip_max_file  = GZIP_DEFAULT_MAX_FILE;
+static tp_config_t g_pool = {
+    .min_workers     = TP_DEFAULT_MIN_WORKERS,
+    .max_workers     = TP_DEFAULT_MAX_WORKERS,
+    .idle_timeout_ms = TP_DEFAULT_IDLE_TIMEOUT_MS,
+    .queue_capacity  = TP_DEFAULT_QUEUE_CAPACITY,
+    .mode            = TP_SHARED,
+    .cpu             = -1,
+};
+static unsigned   g_admission_target_ms   = ADMISSION_DEFAULT_TARGET_MS;
+static unsigned   g_admission_interval_ms = ADMISSION_DEFAULT_INTERVAL_MS;
+static unsigned   g_retry_after           = ADMISSION_DEFAULT_RETRY_AFTER;
+static char       g_access_log[256]       = "";    /* empty = no access log */
+static size_t     g_access_log_records    = ACCESS_LOG_DEFAULT_RECORDS;
+
+/* One SO_REUSEPORT listener with its own reactor and worker group. */
+typedef struct shard_s
 {
-    if (level > g_log_level) return;
-
-    static const char *level_str[] = { "ERROR", "INFO ", "DEBUG" };
-
-    time_t now = time(NULL);
-    struct tm tm_buf;
-    localtime_r(&now, &tm_buf);
-    char ts[20];
-    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm_buf);
-
-    char msg[1024];
-    va_list ap;
-    va_start(ap, fmt);
-    int n = vsnprintf(msg, sizeof(msg), fmt, ap);
-    va_end(ap);
-    if (n < 0) return;
-
-    pthread_mutex_lock(&g_log_mutex);
-    fprintf(stdout, "[%s] [%s] %s", ts, level_str[level], msg);
-    if (g_log_file != NULL)
-    {
-        fprintf(g_log_file, "[%s] [%s] %s", ts, level_str[level], msg);
-        fflush(g_log_file);
-    }
-    pthread_mutex_unlock(&g_log_mutex);
-}
+    int           cpu;          /* -1 when not pinned */
+    int           listen_fd;
+    thread_pool_t pool;
+    event_loop_t  loop;
+    pthread_t     thread;
+} shard_t;
 
 static int load_config(const char *path)
 {
@@ -69,6 +88,23 @@ static int load_config(const char *path)
         if (mi)
         {
             if (strcmp(key, "log_level") == 0) g_log_level = (log_level_t)ival;
+            else if (strcmp(key, "shards") == 0) g_shard_count = (ival > 0) ? ival : 0;
+            else if (strcmp(key, "file_cache_size") == 0)     g_cache_bytes    = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "file_cache_entries") == 0)  g_cache_entries  = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "file_cache_max_file") == 0) g_cache_max_file = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "gzip_cache_size") == 0)     g_gzip_bytes     = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "gzip_cache_entries") == 0)  g_gzip_entries   = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "gzip_max_file") == 0)       g_gzip_max_file  = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "gzip_level") == 0)          g_gzip_level     = (ival < 0) ? 0 : (ival > 9) ? 9 : ival;
+            else if (strcmp(key, "gzip_stream_max") == 0)     g_gzip_stream_max = (ival > 0) ? (size_t)ival : 0;
+            else if (strcmp(key, "admission_target_ms") == 0)   g_admission_target_ms   = (ival > 0) ? (unsigned)ival : 0;
+            else if (strcmp(key, "admission_interval_ms") == 0) g_admission_interval_ms = (ival > 0) ? (unsigned)ival : 1;
+            else if (strcmp(key, "retry_after") == 0)           g_retry_after           = (ival > 0) ? (unsigned)ival : 0;
+            else if (strcmp(key, "pool_min_workers") == 0)      g_pool.min_workers      = (ival > 0) ? (size_t)ival : 1;
+            else if (strcmp(key, "pool_max_workers") == 0)      g_pool.max_workers      = (ival > 0) ? (size_t)ival : 1;
+            else if (strcmp(key, "pool_idle_timeout_ms") == 0)  g_pool.idle_timeout_ms  = (ival > 0) ? (unsigned)ival : 1;
+            else if (strcmp(key, "pool_queue_capacity") == 0)   g_pool.queue_capacity   = (ival > 0) ? (size_t)ival : 1;
+            else if (strcmp(key, "access_log_records") == 0)    g_access_log_records    = (ival > 0) ? (size_t)ival : 1;
         }
         if (ms)
         {
@@ -76,6 +112,35 @@ static int load_config(const char *path)
             {
                 g_log_file = fopen(sval, "a");
             }
+            else if (strcmp(key, "io_backend") == 0)
+            {
+                g_io_backend = (strcmp(sval, "io_uring") == 0) ? IO_BACKEND_URING : IO_BACKEND_EPOLL;
+            }
+            else if (strcmp(key, "shards") == 0 && strcmp(sval, "auto") == 0)
+            {
+                long n = sysconf(_SC_NPROCESSORS_ONLN);
+                g_shard_count = (n > 0) ? (int)n : 1;
+            }
+            else if (strcmp(key, "simd") == 0)
+            {
+                if (strcmp(sval, "scalar") == 0)      g_scan_force = SCAN_SCALAR;
+                else if (strcmp(sval, "sse4.2") == 0) g_scan_force = SCAN_SSE42;
+                else                                  g_scan_force = -1;
+            }
+            else if (strcmp(key, "shard_steering") == 0)
+            {
+                if (strcmp(sval, "incoming_cpu") == 0) g_shard_steering = STEER_INCOMING_CPU;
+                else if (strcmp(sval, "bpf") == 0)     g_shard_steering = STEER_BPF;
+                else                                   g_shard_steering = STEER_NONE;
+            }
+            else if (strcmp(key, "pool_mode") == 0)
+            {
+                g_pool.mode = (strcmp(sval, "stealing") == 0) ? TP_STEALING : TP_SHARED;
+            }
+            else if (strcmp(key, "access_log") == 0)
+            {
+                snprintf(g_access_log, sizeof(g_access_log), "%s", sval);
+            }
         }
     }
 
@@ -83,129 +148,233 @@ static int load_config(const char *path)
     return 0;
 }
 
-void handle_client(int client_fd)
+/* Fill in what the request path does not stamp itself, append it to the
+   access log and count it. */
+static void record_request(const connection_t *conn, const char *message, access_record_t *record,
+                           http_error_code http_error, int keep_alive, uint64_t bytes_in)
 {
-    char *message = malloc(BUFFER_SIZE);
-    if (message == NULL) { close(client_fd); return; }
+    const http_request_t *req = &conn->parser.req;
+    int head_done = http_parser_head_done(&conn->parser);
+
+    record->accept_ns     = conn->accept_ns;
+    record->first_byte_ns = conn->first_byte_ns;
+    record->dispatched_ns = conn->queued_ns;
+    record->last_byte_ns  = monotonic_ns();
+    record->bytes_sent    = t_send_meter.bytes;
+    record->status        = (t_send_meter.status != 0) ? t_send_meter.status : (uint16_t)http_error;
+    record->method        = head_done ? req->method_code : METHOD_COUNT;
+    record->keep_alive    = (uint8_t)keep_alive;
+    if (head_done) access_record_set_target(record, message + req->target.off, req->target.len);
+    if (access_log_enabled()) access_log_write(record);
+    metrics_record(record->resource_id, record->method, record->status, bytes_in, record->bytes_sent,
+                   (record->first_byte_ns != 0) ? record->last_byte_ns - record->first_byte_ns : 0);
+}
 
-    do
-    {
-        http_message_t parsed_message;
-        memset(&parsed_message, 0, sizeof(parsed_message));
-        char *response = NULL;
-        int keep_alive = 0;
+/* Answer one request whose parse ended in `status`. `message` is where the
+   request starts in the connection buffer. Returns 1 to keep the
+   connection open. */
+static int handle_request(connection_t *conn, const char *message, size_t length, http_parse_status status)
+{
+    int client_fd = conn->fd;
 
-        ssize_t bytes_received = recv(client_fd, message, BUFFER_SIZE - 1, 0);
-        if (bytes_received > 0)
-        {
-            message[bytes_received] = '\0';
-            log_write(LOG_DEBUG, "Received: %ld bytes\n%s\n", bytes_received, message);
+    http_message_t parsed_message;
+    memset(&parsed_message, 0, sizeof(parsed_message));
+    parsed_message.arena = &conn->arena;
+    parsed_message.resource_id = -1;
+    char *response = NULL;
 
-            http_error_code http_error = http_parse_message(message, bytes_received, &parsed_message);
-            log_write(LOG_DEBUG, "Parsed message with error %s\n", get_http_error_name(http_error));
+    access_record_t record;
+    int timed = (conn->accept_ns != 0);
+    if (timed)
+    {
+        memset(&record, 0, sizeof(record));
+        record.started_ns = monotonic_ns();
+        send_meter_reset();
+    }
 
-            if (http_error == Ok)
-            {
-                http_error = http_validate_message(&parsed_message);
-                log_write(LOG_DEBUG, "Validated message with error %s\n", get_http_error_name(http_error));
+    /* Dispatched with the head but not the whole body: an upload that
+       method_action() streams off the socket, or a 413 from validation. */
+    int head_done = http_parser_head_done(&conn->parser);
+
+    /* Never the raw bytes: they carry cookies and credentials. */
+    const http_request_t *req = &conn->parser.req;
+    if (head_done)
+        log_write(LOG_DEBUG, "Received: %.*s /%.*s, %zu bytes\n", (int)req->method.len, message + req->method.off,
+                  (int)req->target.len, message + req->target.off,
+                  (status == HTTP_PARSE_DONE) ? conn->parser.pos : length);
+    else
+        log_write(LOG_DEBUG, "Received: %zu bytes, head incomplete\n", length);
+
+    http_error_code http_error;
+    if (status == HTTP_PARSE_DONE || (status == HTTP_PARSE_NEED_MORE && head_done))
+        http_error = http_message_from_request(&parsed_message, message, req);
+    else if (status == HTTP_PARSE_ERROR)
+        http_error = (http_error_code)conn->parser.error;
+    else    /* dispatched incomplete: the head would not fit in the buffer */
+        http_error = Bad_Request;
+    log_write(LOG_DEBUG, "Parsed message with error %s\n", get_http_error_name(http_error));
+    if (timed) record.parsed_ns = monotonic_ns();
+
+    if (http_error == Ok)
+    {
+        http_error = http_validate_message(&parsed_message);
+        log_write(LOG_DEBUG, "Validated message with error %s\n", get_http_error_name(http_error));
+        if (timed) record.validated_ns = monotonic_ns();
+    }
+    if (timed) record.resource_id = parsed_message.resource_id;
 
-            }else if(http_error == No_Content)
-            {
-                char  *headers_end = strstr(message, "\r\n\r\n");
-                size_t body_offset = (headers_end != NULL)
-                                     ? (size_t)(headers_end + 4 - message)
-                                     : (size_t)bytes_received;
-                size_t body_present = (size_t)bytes_received - body_offset;
-
-                if (parsed_message.headers.content_length == NULL || headers_end == NULL)
-                {
-                    http_error = Bad_Request;
-                }
-                else if ((*parsed_message.headers.content_length) >
-                         ((size_t)(BUFFER_SIZE - 1) - body_offset))
-                {
-                    http_error = Content_Too_Large;
-                }
-                else
-                {
-                    size_t content_length  = *parsed_message.headers.content_length;
-                    size_t total_bytes_rcv = body_present;
-
-                    while (total_bytes_rcv < content_length)
-                    {
-                        ssize_t n = recv(client_fd,
-                                         message + body_offset + total_bytes_rcv,
-                                         content_length - total_bytes_rcv, 0);
-                        if (n <= 0) break;
-                        total_bytes_rcv += (size_t)n;
-                    }
-
-                    if (total_bytes_rcv != content_length)
-                    {
-                        http_error = Bad_Request;
-                    }
-                    else
-                    {
-                        parsed_message.content = strstrcpy(message + body_offset, content_length);
-                        log_write(LOG_DEBUG, "Content:\n%s\n", parsed_message.content);
-                        http_error = http_validate_message(&parsed_message);
-                    }
-                }
-            }
+    size_t response_len = http_build_response(http_error, &parsed_message, &response, client_fd);
+    if (response != NULL && response_len > 0)
+    {
+        int sent = send_all(client_fd, response, response_len);
+        log_write(LOG_DEBUG, "Sent: %ld bytes\n", (sent == 0) ? (long)response_len : -1L);
+    }
 
-            size_t response_len = http_build_response(http_error, &parsed_message, &response, client_fd);
-            if (response != NULL && response_len > 0)
-            {
-                ssize_t bytes_sent = send(client_fd, response, response_len, 0);
-                log_write(LOG_DEBUG, "Sent: %ld bytes\n", bytes_sent);
-            }
+    /* After a malformed or truncated request, or a body left unread, the
+       stream is out of sync. */
+    int keep_alive = (status != HTTP_PARSE_ERROR && head_done &&
+                      http_body_complete(&parsed_message) &&
+                      parsed_message.headers.connection != NULL && parsed_message.headers.connection->keep_alive);
+    if (timed)
+    {
+        /* Everything up to the end of the body, however much was read. */
+        uint64_t bytes_in = (status == HTTP_PARSE_DONE) ? conn->parser.pos
+                          : head_done ? conn->parser.req.head_len + parsed_message.content_received
+                          : length;
+        record_request(conn, message, &record, http_error, keep_alive, bytes_in);
+    }
 
-            keep_alive = (parsed_message.headers.connection != NULL && parsed_message.headers.connection->keep_alive);
+    http_message_free(&parsed_message);     /* also drops response */
+    return keep_alive;
+}
 
-            free(response);
-            http_message_free(&parsed_message);
-        }
-        else if(bytes_received == 0)
-        {
-            log_write(LOG_DEBUG, "Closing connection as requested\n");
-            break;
-        }else
+/* Answers the requests already buffered, in order, up to PIPELINE_SLICE
+   of them. Returns 1 if it stopped there with another complete request
+   waiting (the connection stays with the caller, its parser holding that
+   request), else 0 once it kept the bytes of an incomplete one and handed
+   the connection back. */
+static int answer_buffered(connection_t *conn)
+{
+    int client_fd = conn->fd;
+
+    /* The reactor (or the previous slice) already ran the parser over the
+       first request; this only reads back its verdict. */
+    size_t   offset   = 0;
+    int      corked   = 0;
+    int      more     = 0;
+    unsigned answered = 0;
+    http_parse_status status = http_parser_execute(&conn->parser, conn->buf, conn->len);
+    int keep_alive;
+
+    /* Pipelined: if the next request is already here too, cork before the
+       first response so the batch leaves in full segments. Its parse is
+       kept for the loop below. */
+    http_parser_t     next;
+    http_parse_status next_status = HTTP_PARSE_NEED_MORE;
+    if (status == HTTP_PARSE_DONE && conn->parser.pos < conn->len)
+    {
+        http_parser_init(&next);
+        next_status = http_parser_execute(&next, conn->buf + conn->parser.pos, conn->len - conn->parser.pos);
+        if (next_status != HTTP_PARSE_NEED_MORE)
         {
-            log_write(LOG_DEBUG, "Error on recv\n");
-            break;
+            int one = 1;
+            corked = (setsockopt(client_fd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one)) == 0);
         }
+    }
 
+    for (;;)
+    {
+        keep_alive = handle_request(conn, conn->buf + offset, conn->len - offset, status);
         if (!keep_alive) break;
 
-    }while (1);
+        /* A streamed upload consumed everything buffered behind its head. */
+        offset += (status == HTTP_PARSE_DONE) ? conn->parser.pos : conn->len - offset;
+        http_parser_init(&conn->parser);
+        conn->first_byte_ns = 0;
+        if (offset == conn->len) break;
+
+        /* The next request's bytes are already here and so is a worker:
+           its clock starts now. */
+        if (conn->accept_ns != 0) conn->first_byte_ns = conn->queued_ns = monotonic_ns();
+
+        /* Pipelined: the next request is already here. */
+        if (next_status != HTTP_PARSE_NEED_MORE)
+        {
+            conn->parser = next;
+            status       = next_status;
+            next_status  = HTTP_PARSE_NEED_MORE;
+        }
+        else
+            status = http_parser_execute(&conn->parser, conn->buf + offset, conn->len - offset);
+        if (status == HTTP_PARSE_NEED_MORE) break;
+        if (++answered == PIPELINE_SLICE) { more = 1; break; }
+    }
+
+    if (corked)
+    {
+        int zero = 0;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero));
+    }
+
+    if (!more && (!keep_alive || conn->peer_closed))
+    {
+        event_loop_close(conn);
+        return 0;
+    }
+
+    /* Keep the start of the next request; the parser has already seen it
+       and its slices are relative to that start. */
+    conn->len -= offset;
+    if (conn->len > 0 && offset > 0)
+        memmove(conn->buf, conn->buf + offset, conn->len);
+    if (more) return 1;
 
-    free(message);
-    close(client_fd);
+    event_loop_rearm(conn);
+    return 0;
 }
 
-int main(void)
+/* Runs on a pool worker once the reactor's parser has a complete request
+   (or gave up on it). A long pipeline goes back through the pool a slice
+   at a time so one client cannot hold a worker; in TP_STEALING mode the
+   follow-up stays on this worker's deque unless an idle one steals it. */
+void handle_client(int client_fd)
 {
-    load_config(CONFIG_CONF);
+    connection_t *conn = event_loop_conn(client_fd);
+    if (conn == NULL) { close(client_fd); return; }
 
-    if (load_resources(RESOURCES_CONF) != 0)
+    while (answer_buffered(conn))
     {
-        log_write(LOG_ERROR, "Failed to load resources from: %s\n", RESOURCES_CONF);
-        return EXIT_FAILURE;
+        conn->queued_ns = monotonic_ns();
+        if (conn->accept_ns != 0) conn->first_byte_ns = conn->queued_ns;
+
+        tp_task_t rest = { handle_client, client_fd };
+        if (thread_pool_requeue(conn->loop->pool, rest) == 0) return;
+        /* Every queue is full: answer the next slice here. */
     }
+}
 
+static int open_listener(int reuseport)
+{
     int server_fd;
     struct sockaddr_in server_addr;
 
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd < 0)
     {
         log_write(LOG_ERROR, "socket creation failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0)
+    {
+        log_write(LOG_ERROR, "SO_REUSEPORT failed: %s\n", strerror(errno));
+        close(server_fd);
+        return -1;
+    }
 
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(PORT);
@@ -213,40 +382,151 @@ int main(void)
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
     {
         log_write(LOG_ERROR, "bind failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        close(server_fd);
+        return -1;
     }
 
-    if (listen(server_fd, N_CONNECTIONS) < 0)
+    if (listen(server_fd, SOMAXCONN) < 0)
     {
         log_write(LOG_ERROR, "listen failed: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+        close(server_fd);
+        return -1;
     }
+    return server_fd;
+}
 
-    thread_pool_t pool;
-    if (thread_pool_init(&pool, WORKER_COUNT, QUEUE_CAPACITY, handle_client) != 0)
+/* Keep a connection on the CPU that took its interrupts. Listeners are
+   opened in shard order, so shard i is index i of the reuseport group. */
+static void apply_steering(int listen_fd, int cpu, int first)
+{
+    switch (g_shard_steering)
+    {
+    case STEER_INCOMING_CPU:
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0)
+            log_write(LOG_ERROR, "SO_INCOMING_CPU failed: %s\n", strerror(errno));
+        break;
+
+    case STEER_BPF:
+    {
+        /* The program is shared by the whole group: attach it once.
+           Returns (receiving cpu % shards) as the socket index. */
+        if (!first) break;
+        struct sock_filter code[] = {
+            { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+            { BPF_ALU | BPF_MOD | BPF_K,   0, 0, (uint32_t)g_shard_count },
+            { BPF_RET | BPF_A,             0, 0, 0 },
+        };
+        struct sock_fprog prog = { .len = sizeof(code)/sizeof(code[0]), .filter = code };
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0)
+            log_write(LOG_ERROR, "SO_ATTACH_REUSEPORT_CBPF failed: %s\n", strerror(errno));
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static void *shard_main(void *arg)
+{
+    shard_t *shard = arg;
+
+    if (shard->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    event_loop_run(&shard->loop);
+    return NULL;
+}
+
+int main(void)
+{
+    load_config(CONFIG_CONF);
+    if (log_start() != 0)
+        log_write(LOG_ERROR, "Failed to start the log flusher, logging synchronously\n");
+    if (g_access_log[0] != '\0' && access_log_open(g_access_log, g_access_log_records) == 0)
+        log_write(LOG_INFO, "Access log: %s (%zu records)\n", g_access_log, g_access_log_records);
+
+    log_write(LOG_INFO, "Header scanning: %s\n", scan_impl_name(scan_init(g_scan_force)));
+    file_cache_init(&g_file_cache, g_cache_bytes, g_cache_entries, g_cache_max_file);
+    file_cache_init(&g_gzip_cache, g_gzip_bytes,  g_gzip_entries,  g_gzip_max_file);
+
+    if (g_io_backend == IO_BACKEND_URING && !uring_supported())
+    {
+        log_write(LOG_INFO, "io_uring not supported by this kernel, using epoll\n");
+        g_io_backend = IO_BACKEND_EPOLL;
+    }
+
+    /* Peers may reset mid-response; report EPIPE instead of dying. */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (load_resources(RESOURCES_CONF) != 0)
     {
-        log_write(LOG_ERROR, "thread_pool_init failed\n");
-        exit(EXIT_FAILURE);
+        log_write(LOG_ERROR, "Failed to load resources from: %s\n", RESOURCES_CONF);
+        return EXIT_FAILURE;
     }
+    metrics_init();
+
+    /* The worker limits are for the whole server; each shard gets a share. */
+    size_t shard_count = (g_shard_count > 0) ? (size_t)g_shard_count : 1;
+    if (g_pool.max_workers < g_pool.min_workers) g_pool.max_workers = g_pool.min_workers;
+    tp_config_t pool_config = g_pool;
+    pool_config.min_workers = g_pool.min_workers / shard_count;
+    pool_config.max_workers = g_pool.max_workers / shard_count;
+    if (pool_config.min_workers == 0) pool_config.min_workers = 1;
+    if (pool_config.max_workers < pool_config.min_workers) pool_config.max_workers = pool_config.min_workers;
+
+    shard_t *shards = calloc(shard_count, sizeof(shard_t));
+    if (shards == NULL) exit(EXIT_FAILURE);
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) online = 1;
 
-    while (1)
+    for (size_t i = 0; i < shard_count; i++)
     {
-        struct sockaddr_in client_addr;
-        socklen_t client_addr_len = sizeof(client_addr);
+        shard_t *shard = &shards[i];
+        shard->cpu       = (g_shard_count > 0) ? (int)(i % (size_t)online) : -1;
+        shard->listen_fd = open_listener(g_shard_count > 0);
+        if (shard->listen_fd < 0) exit(EXIT_FAILURE);
 
-        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_addr_len);
-        if (client_fd < 0)
+        if (shard->cpu >= 0)
+            apply_steering(shard->listen_fd, shard->cpu, i == 0);
+
+        pool_config.cpu = shard->cpu;
+        if (thread_pool_init(&shard->pool, &pool_config, handle_client) != 0)
         {
-            log_write(LOG_ERROR, "accept failed: %s\n", strerror(errno));
-            continue;
+            log_write(LOG_ERROR, "thread_pool_init failed\n");
+            exit(EXIT_FAILURE);
         }
 
-        if (thread_pool_submit(&pool, client_fd) != 0)
+        if (event_loop_init(&shard->loop, shard->listen_fd, &shard->pool) != 0)
+        {
+            log_write(LOG_ERROR, "event_loop_init failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        admission_init(&shard->loop.admission, g_admission_target_ms, g_admission_interval_ms, g_retry_after);
+        if (metrics_add_loop(&shard->loop) != 0) exit(EXIT_FAILURE);
+    }
+
+    if (g_shard_count > 0)
+        log_write(LOG_INFO, "Running %zu SO_REUSEPORT shards\n", shard_count);
+    log_write(LOG_INFO, "Workers per shard: %zu to %zu, idle timeout %u ms\n",
+              pool_config.min_workers, pool_config.max_workers, pool_config.idle_timeout_ms);
+
+    /* Shard 0 runs on the main thread, the rest get their own acceptor. */
+    for (size_t i = 1; i < shard_count; i++)
+    {
+        if (pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]) != 0)
         {
-            /* Pool full — connection was closed by submit. Silent drop. */
-            log_write(LOG_INFO, "Pool full, dropping connection\n");
+            log_write(LOG_ERROR, "Failed to start shard %zu\n", i);
+            exit(EXIT_FAILURE);
         }
     }
+    shard_main(&shards[0]);
 
     return 0;
 }
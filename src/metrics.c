@@ -0,0 +1,407 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/admission.h"
+#include "../include/buffer_pool.h"
+#include "../include/event_loop.h"
+#include "../include/log.h"
+#include "../include/metrics.h"
+#include "../include/server.h"
+#include "../include/thread_pool.h"
+
+/* Dense index for every status in HTTP_ERRORS, plus one for anything else. */
+#define X(name, value) STATUS_##name,
+enum { HTTP_ERRORS STATUS_OTHER, STATUS_SLOTS };
+#undef X
+
+#define X(name, value) value,
+static const uint16_t status_codes[] = { HTTP_ERRORS };
+#undef X
+
+/* One row of counters per resource, and a last one for requests that
+   matched none. */
+#define ROW_REQUESTS    0                                           /* [method][status] */
+#define ROW_BYTES_IN    (ROW_REQUESTS + (METHOD_COUNT + 1) * STATUS_SLOTS)
+#define ROW_BYTES_OUT   (ROW_BYTES_IN + 1)
+#define ROW_LATENCY     (ROW_BYTES_OUT + 1)                         /* buckets, then +Inf */
+#define ROW_LATENCY_NS  (ROW_LATENCY + METRICS_LAT_BUCKETS + 1)
+#define ROW_WORDS       (ROW_LATENCY_NS + 1)
+
+/* A thread's counters. Only the owner writes them (plain load, relaxed
+   store); a scrape reads them with relaxed loads. */
+typedef struct metrics_block_s
+{
+    uint32_t                owned;
+    struct metrics_block_s *next;       /* registry; blocks are never freed */
+    uint64_t                counters[] __attribute__((aligned(METRICS_CACHE_LINE)));
+} metrics_block_t;
+
+static metrics_block_t        *g_blocks    = NULL;
+static __thread metrics_block_t *tls_block;
+static pthread_key_t           g_block_key;
+static pthread_once_t          g_block_key_once = PTHREAD_ONCE_INIT;
+static size_t                  g_rows       = 0;    /* 0 = metrics off */
+
+static struct event_loop_s   **g_loops      = NULL;
+static size_t                  g_loop_count = 0;
+
+static void block_release(void *arg)
+{
+    __atomic_store_n(&((metrics_block_t *)arg)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void block_key_init(void)
+{
+    pthread_key_create(&g_block_key, block_release);
+}
+
+/* The calling thread's block: one a finished thread left behind, or a new
+   one. NULL if out of memory. */
+static metrics_block_t *block_get(void)
+{
+    if (tls_block != NULL) return tls_block;
+    pthread_once(&g_block_key_once, block_key_init);
+
+    metrics_block_t *block = __atomic_load_n(&g_blocks, __ATOMIC_ACQUIRE);
+    for (; block != NULL; block = block->next)
+    {
+        uint32_t free_block = 0;
+        if (__atomic_compare_exchange_n(&block->owned, &free_block, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if (block == NULL)
+    {
+        /* Rounded up to whole lines so the next thread's block starts on
+           a line of its own. */
+        size_t size = sizeof(metrics_block_t) + g_rows * ROW_WORDS * sizeof(uint64_t);
+        size = (size + METRICS_CACHE_LINE - 1) & ~(size_t)(METRICS_CACHE_LINE - 1);
+        block = aligned_alloc(METRICS_CACHE_LINE, size);
+        if (block == NULL) return NULL;
+        memset(block, 0, size);
+        block->owned = 1;
+        block->next  = __atomic_load_n(&g_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    tls_block = block;
+    pthread_setspecific(g_block_key, block);
+    return block;
+}
+
+static inline void bump(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static unsigned status_slot(unsigned status)
+{
+    switch (status) {
+#define X(name, value) case value: return STATUS_##name;
+        HTTP_ERRORS
+#undef X
+        default: return STATUS_OTHER;
+    }
+}
+
+/* Bucket of a latency: bounds are inclusive, in whole microseconds. */
+static unsigned latency_bucket(uint64_t ns)
+{
+    uint64_t us = (ns + 999) / 1000;
+    uint64_t x  = (us > 0) ? us - 1 : 0;
+    if (x < (1u << METRICS_LAT_MIN_SHIFT)) return 0;
+
+    unsigned k = 63 - (unsigned)__builtin_clzll(x);
+    if (k >= METRICS_LAT_MIN_SHIFT + METRICS_LAT_OCTAVES) return METRICS_LAT_BUCKETS;   /* +Inf */
+
+    unsigned sub = (unsigned)(x >> (k - METRICS_LAT_SUB_BITS)) & ((1u << METRICS_LAT_SUB_BITS) - 1);
+    return 1 + (k - METRICS_LAT_MIN_SHIFT) * (1u << METRICS_LAT_SUB_BITS) + sub;
+}
+
+/* Upper bound of a finite bucket, in microseconds. */
+static uint64_t latency_bound_us(unsigned bucket)
+{
+    if (bucket == 0) return 1u << METRICS_LAT_MIN_SHIFT;
+    unsigned k   = METRICS_LAT_MIN_SHIFT + (bucket - 1) / (1u << METRICS_LAT_SUB_BITS);
+    unsigned sub = (bucket - 1) % (1u << METRICS_LAT_SUB_BITS);
+    return (1ull << k) + ((uint64_t)(sub + 1) << (k - METRICS_LAT_SUB_BITS));
+}
+
+void metrics_init(void)
+{
+    g_rows = 0;
+    for (size_t i = 0; i < g_resource_count; i++)
+        if (g_resources[i].builtin == BUILTIN_METRICS) g_rows = g_resource_count + 1;
+}
+
+int metrics_enabled(void)
+{
+    return g_rows != 0;
+}
+
+int metrics_add_loop(struct event_loop_s *loop)
+{
+    struct event_loop_s **loops = realloc(g_loops, (g_loop_count + 1) * sizeof(*loops));
+    if (loops == NULL) return -1;
+    loops[g_loop_count] = loop;
+    g_loops = loops;
+    g_loop_count++;
+    return 0;
+}
+
+void metrics_record(int resource_id, unsigned method, unsigned status,
+                    uint64_t bytes_in, uint64_t bytes_out, uint64_t latency_ns)
+{
+    if (g_rows == 0) return;
+    metrics_block_t *block = block_get();
+    if (block == NULL) return;
+
+    size_t    row = (resource_id >= 0 && (size_t)resource_id < g_rows - 1) ? (size_t)resource_id : g_rows - 1;
+    uint64_t *c   = block->counters + row * ROW_WORDS;
+
+    if (method > METHOD_COUNT) method = METHOD_COUNT;
+    bump(&c[ROW_REQUESTS + method * STATUS_SLOTS + status_slot(status)], 1);
+    bump(&c[ROW_BYTES_IN], bytes_in);
+    bump(&c[ROW_BYTES_OUT], bytes_out);
+    bump(&c[ROW_LATENCY + latency_bucket(latency_ns)], 1);
+    bump(&c[ROW_LATENCY_NS], latency_ns);
+}
+
+/*----------------------------------------------*/
+/*                 Exposition                   */
+/*----------------------------------------------*/
+
+typedef struct text_s
+{
+    char  *data;
+    size_t len;
+    size_t cap;
+    int    failed;
+} text_t;
+
+static void text_printf(text_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void text_printf(text_t *t, const char *fmt, ...)
+{
+    for (;;)
+    {
+        if (t->failed) return;
+
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->data + t->len, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) { t->failed = 1; return; }
+        if ((size_t)n < t->cap - t->len) { t->len += (size_t)n; return; }
+
+        size_t cap  = (t->cap * 2 > t->len + (size_t)n + 1) ? t->cap * 2 : t->len + (size_t)n + 1;
+        char  *data = realloc(t->data, cap);
+        if (data == NULL) { t->failed = 1; return; }
+        t->data = data;
+        t->cap  = cap;
+    }
+}
+
+static void text_family(text_t *t, const char *name, const char *type, const char *help)
+{
+    text_printf(t, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* A route label: the resource name, with '\' and '"' escaped. */
+static void route_label(char *out, size_t size, size_t row)
+{
+    const char *name = (row < g_resource_count) ? g_resources[row].name : "(none)";
+    size_t j = 0;
+    for (; *name != '\0' && j + 2 < size; name++)
+    {
+        if (*name == '\\' || *name == '"') out[j++] = '\\';
+        out[j++] = *name;
+    }
+    out[j] = '\0';
+}
+
+static void render_requests(text_t *t, const uint64_t *sum)
+{
+    char route[2 * sizeof(g_resources[0].name)];
+
+    text_family(t, "http_requests_total", "counter", "Requests answered, by route, method and status.");
+    for (size_t row = 0; row < g_rows; row++)
+    {
+        route_label(route, sizeof(route), row);
+        const uint64_t *c = sum + row * ROW_WORDS;
+        for (unsigned m = 0; m <= METHOD_COUNT; m++)
+            for (unsigned s = 0; s < STATUS_SLOTS; s++)
+            {
+                uint64_t n = c[ROW_REQUESTS + m * STATUS_SLOTS + s];
+                if (n == 0) continue;
+                char status[8];
+                if (s < STATUS_OTHER) snprintf(status, sizeof(status), "%u", (unsigned)status_codes[s]);
+                else                  snprintf(status, sizeof(status), "other");
+                text_printf(t, "http_requests_total{route=\"%s\",method=\"%s\",status=\"%s\"} %llu\n",
+                            route, (m < METHOD_COUNT) ? http_methods_name[m] : "unknown", status,
+                            (unsigned long long)n);
+            }
+    }
+
+    static const struct { const char *name; size_t word; const char *help; } bytes[] = {
+        { "http_request_bytes_total",  ROW_BYTES_IN,  "Request bytes read, head and body." },
+        { "http_response_bytes_total", ROW_BYTES_OUT, "Response bytes sent, head and body." },
+    };
+    for (size_t b = 0; b < sizeof(bytes) / sizeof(bytes[0]); b++)
+    {
+        text_family(t, bytes[b].name, "counter", bytes[b].help);
+        for (size_t row = 0; row < g_rows; row++)
+        {
+            route_label(route, sizeof(route), row);
+            text_printf(t, "%s{route=\"%s\"} %llu\n", bytes[b].name, route,
+                        (unsigned long long)sum[row * ROW_WORDS + bytes[b].word]);
+        }
+    }
+
+    text_family(t, "http_request_duration_seconds", "histogram",
+                "From the first byte of a request read to the last byte of its response sent.");
+    for (size_t row = 0; row < g_rows; row++)
+    {
+        route_label(route, sizeof(route), row);
+        const uint64_t *c = sum + row * ROW_WORDS;
+        uint64_t cumulative = 0;
+        for (unsigned b = 0; b < METRICS_LAT_BUCKETS; b++)
+        {
+            cumulative += c[ROW_LATENCY + b];
+            text_printf(t, "http_request_duration_seconds_bucket{route=\"%s\",le=\"%g\"} %llu\n",
+                        route, (double)latency_bound_us(b) / 1e6, (unsigned long long)cumulative);
+        }
+        cumulative += c[ROW_LATENCY + METRICS_LAT_BUCKETS];
+        text_printf(t, "http_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %llu\n",
+                    route, (unsigned long long)cumulative);
+        text_printf(t, "http_request_duration_seconds_sum{route=\"%s\"} %.9f\n",
+                    route, (double)c[ROW_LATENCY_NS] / 1e9);
+        text_printf(t, "http_request_duration_seconds_count{route=\"%s\"} %llu\n",
+                    route, (unsigned long long)cumulative);
+    }
+}
+
+static void render_loops(text_t *t)
+{
+    tp_stats_t        *pools = calloc(g_loop_count ? g_loop_count : 1, sizeof(tp_stats_t));
+    admission_stats_t *adms  = calloc(g_loop_count ? g_loop_count : 1, sizeof(admission_stats_t));
+    if (pools == NULL || adms == NULL) { free(pools); free(adms); t->failed = 1; return; }
+
+    for (size_t i = 0; i < g_loop_count; i++)
+    {
+        thread_pool_get_stats(g_loops[i]->pool, &pools[i]);
+        admission_get_stats(&g_loops[i]->admission, &adms[i]);
+    }
+
+#define SHARD_SERIES(metric, type, help, fmt, value)                                    \
+    do {                                                                                \
+        text_family(t, metric, type, help);                                             \
+        for (size_t i = 0; i < g_loop_count; i++)                                       \
+            text_printf(t, metric "{shard=\"%zu\"} " fmt "\n", i, value);               \
+    } while (0)
+
+    SHARD_SERIES("http_pool_workers", "gauge", "Worker threads running.",
+                 "%zu", pools[i].workers);
+    SHARD_SERIES("http_pool_idle_workers", "gauge", "Workers parked waiting for work.",
+                 "%zu", pools[i].idle);
+    SHARD_SERIES("http_pool_queue_depth", "gauge", "Dispatched connections waiting for a worker.",
+                 "%zu", pools[i].queued);
+    SHARD_SERIES("http_pool_tasks_total", "counter", "Dispatches run by the workers.",
+                 "%llu", (unsigned long long)pools[i].tasks);
+    SHARD_SERIES("http_pool_busy_seconds_total", "counter", "Time the workers spent running tasks.",
+                 "%.9f", (double)pools[i].busy_ns / 1e9);
+    SHARD_SERIES("http_pool_queue_wait_max_seconds", "gauge", "Longest wait for a worker so far.",
+                 "%.9f", (double)adms[i].delay_max_ns / 1e9);
+    SHARD_SERIES("http_admission_shedding", "gauge", "1 while queue delay is above target.",
+                 "%d", adms[i].shedding);
+#undef SHARD_SERIES
+
+    text_family(t, "http_pool_queue_wait_seconds", "summary", "Time dispatches waited for a worker.");
+    for (size_t i = 0; i < g_loop_count; i++)
+    {
+        text_printf(t, "http_pool_queue_wait_seconds_sum{shard=\"%zu\"} %.9f\n",
+                    i, (double)adms[i].delay_sum_ns / 1e9);
+        text_printf(t, "http_pool_queue_wait_seconds_count{shard=\"%zu\"} %llu\n",
+                    i, (unsigned long long)adms[i].delay_count);
+    }
+
+    text_family(t, "http_shed_total", "counter", "Dispatches answered with a 503 instead of queued.");
+    for (size_t i = 0; i < g_loop_count; i++)
+    {
+        text_printf(t, "http_shed_total{shard=\"%zu\",reason=\"queue_full\"} %llu\n",
+                    i, (unsigned long long)adms[i].shed_full);
+        text_printf(t, "http_shed_total{shard=\"%zu\",reason=\"delay\"} %llu\n",
+                    i, (unsigned long long)adms[i].shed_delay);
+    }
+
+    free(pools);
+    free(adms);
+}
+
+static void render_process(text_t *t)
+{
+    text_family(t, "http_connections_active", "gauge", "Open client connections.");
+    text_printf(t, "http_connections_active %zu\n", event_loop_connections());
+
+    buffer_pool_stats_t bp;
+    buffer_pool_get_stats(&bp);
+    text_family(t, "http_buffer_pool_acquires_total", "counter", "Receive buffers taken, by where they came from.");
+    text_printf(t, "http_buffer_pool_acquires_total{source=\"pool\"} %llu\n", (unsigned long long)bp.hits);
+    text_printf(t, "http_buffer_pool_acquires_total{source=\"malloc\"} %llu\n", (unsigned long long)bp.misses);
+    text_family(t, "http_buffer_pool_depot_bytes", "gauge", "Bytes parked in the shared depot.");
+    text_printf(t, "http_buffer_pool_depot_bytes %zu\n", bp.depot_bytes);
+
+    static const char *const names[] = { "file", "gzip" };
+    file_cache_stats_t cs[2];
+    file_cache_get_stats(&g_file_cache, &cs[0]);
+    file_cache_get_stats(&g_gzip_cache, &cs[1]);
+
+#define CACHE_SERIES(metric, type, help, fmt, value)                                    \
+    do {                                                                                \
+        text_family(t, metric, type, help);                                             \
+        for (int i = 0; i < 2; i++)                                                     \
+            text_printf(t, metric "{cache=\"%s\"} " fmt "\n", names[i], value);         \
+    } while (0)
+
+    CACHE_SERIES("http_cache_hits_total", "counter", "Lookups served from the cache.",
+                 "%llu", (unsigned long long)cs[i].hits);
+    CACHE_SERIES("http_cache_misses_total", "counter", "Lookups that missed.",
+                 "%llu", (unsigned long long)cs[i].misses);
+    CACHE_SERIES("http_cache_evictions_total", "counter", "Entries evicted to make room.",
+                 "%llu", (unsigned long long)cs[i].evictions);
+    CACHE_SERIES("http_cache_entries", "gauge", "Entries held.",
+                 "%zu", cs[i].entries);
+    CACHE_SERIES("http_cache_bytes", "gauge", "Bytes held.",
+                 "%zu", cs[i].bytes);
+#undef CACHE_SERIES
+
+    log_stats_t ls;
+    log_get_stats(&ls);
+    text_family(t, "http_log_messages_total", "counter", "Log messages, by fate.");
+    text_printf(t, "http_log_messages_total{result=\"written\"} %llu\n", (unsigned long long)ls.written);
+    text_printf(t, "http_log_messages_total{result=\"dropped\"} %llu\n", (unsigned long long)ls.dropped);
+}
+
+char *metrics_render(size_t *length)
+{
+    uint64_t *sum = calloc(g_rows ? g_rows * ROW_WORDS : 1, sizeof(uint64_t));
+    if (sum == NULL) return NULL;
+
+    for (metrics_block_t *block = __atomic_load_n(&g_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next)
+        for (size_t w = 0; w < g_rows * ROW_WORDS; w++)
+            sum[w] += __atomic_load_n(&block->counters[w], __ATOMIC_RELAXED);
+
+    text_t t = { malloc(16384), 0, 16384, 0 };
+    if (t.data == NULL) t.failed = 1;
+    render_requests(&t, sum);
+    render_loops(&t);
+    render_process(&t);
+    free(sum);
+
+    if (t.failed || t.data == NULL) { free(t.data); return NULL; }
+    *length = t.len;
+    return t.data;
+}
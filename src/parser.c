@@ -0,0 +1,525 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include "../include/config.h"
+#include "../include/parser.h"
+#include "../include/scan.h"
+
+http_error_code http_parse_content_length(const char *field, size_t field_size, uint64_t *value)
+{
+    /* Reject leading sign/whitespace up front so "-1" can't wrap into a huge
+       size. RFC 9110: Content-Length is 1*DIGIT only. */
+    if (field_size == 0) return Bad_Request;
+
+    uint64_t val = 0;
+    for (size_t i = 0; i < field_size; i++)
+    {
+        if (field[i] < '0' || field[i] > '9') return Bad_Request;
+        unsigned digit = (unsigned)(field[i] - '0');
+        if (val > (UINT64_MAX - digit) / 10) return Bad_Request;
+        val = val * 10 + digit;
+    }
+    if (val > (uint64_t)SIZE_MAX) return Content_Too_Large;
+
+    *value = val;
+    return Ok;
+}
+
+enum {
+    C_SIZE = 0,
+    C_EXT,
+    C_SIZE_LF,
+    C_DATA,
+    C_DATA_CR,
+    C_DATA_LF,
+    C_TRAILER,
+    C_TRAILER_LINE,
+    C_TRAILER_LF,
+    C_END_LF,
+    C_DONE,
+    C_ERROR
+};
+
+void http_chunked_init(http_chunked_t *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->state = C_SIZE;
+}
+
+int http_chunked_done(const http_chunked_t *dec)
+{
+    return dec->state == C_DONE;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Skip to the CR ending a chunk extension or trailer line; a bare LF or
+   other control byte is malformed. Returns NULL on error. */
+static const char *line_end(const char *p, const char *end)
+{
+    while (p < end && *p != '\r')
+    {
+        if ((unsigned char)*p < 0x20 && *p != '\t') return NULL;
+        p++;
+    }
+    return p;
+}
+
+http_parse_status http_chunked_decode(http_chunked_t *dec, const char *in, size_t length,
+                                      char *out, size_t *used, size_t *produced)
+{
+    const char *p   = in;
+    const char *end = in + length;
+    size_t      n   = 0;
+
+    while (p < end && dec->state != C_DONE && dec->state != C_ERROR)
+    {
+        switch (dec->state)
+        {
+        case C_SIZE:
+        {
+            int v = hex_value(*p);
+            if (v >= 0)
+            {
+                /* 16 digits already fill 64 bits. */
+                if (dec->digits == 16) { dec->state = C_ERROR; break; }
+                dec->size = (dec->size << 4) | (uint64_t)v;
+                dec->digits++;
+            }
+            else if (dec->digits == 0)                   dec->state = C_ERROR;
+            else if (*p == '\r')                         dec->state = C_SIZE_LF;
+            else if (*p == ';' || *p == ' ' || *p == '\t') dec->state = C_EXT;
+            else                                         dec->state = C_ERROR;
+            p++;
+            break;
+        }
+
+        case C_EXT:
+            p = line_end(p, end);
+            if (p == NULL) { dec->state = C_ERROR; p = end; break; }
+            if (p == end) break;
+            p++;
+            dec->state = C_SIZE_LF;
+            break;
+
+        case C_SIZE_LF:
+            if (*p++ != '\n') { dec->state = C_ERROR; break; }
+            dec->digits = 0;
+            dec->state  = (dec->size == 0) ? C_TRAILER : C_DATA;
+            break;
+
+        case C_DATA:
+        {
+            size_t take = ((uint64_t)(end - p) < dec->size) ? (size_t)(end - p) : (size_t)dec->size;
+            if (out != NULL) memmove(out + n, p, take);
+            p          += take;
+            n          += take;
+            dec->size  -= take;
+            dec->total += take;
+            if (dec->size == 0) dec->state = C_DATA_CR;
+            break;
+        }
+
+        case C_DATA_CR:
+            dec->state = (*p++ == '\r') ? C_DATA_LF : C_ERROR;
+            break;
+
+        case C_DATA_LF:
+            dec->state = (*p++ == '\n') ? C_SIZE : C_ERROR;
+            break;
+
+        case C_TRAILER:
+            /* An empty line ends the body; anything else is a trailer field. */
+            if (*p == '\r') { p++; dec->state = C_END_LF; break; }
+            dec->state = C_TRAILER_LINE;
+            /* fallthrough */
+
+        case C_TRAILER_LINE:
+            p = line_end(p, end);
+            if (p == NULL) { dec->state = C_ERROR; p = end; break; }
+            if (p == end) break;
+            p++;
+            dec->state = C_TRAILER_LF;
+            break;
+
+        case C_TRAILER_LF:
+            dec->state = (*p++ == '\n') ? C_TRAILER : C_ERROR;
+            break;
+
+        case C_END_LF:
+            dec->state = (*p++ == '\n') ? C_DONE : C_ERROR;
+            break;
+        }
+    }
+
+    *used     = (size_t)(p - in);
+    *produced = n;
+    if (dec->state == C_DONE)  return HTTP_PARSE_DONE;
+    if (dec->state == C_ERROR) return HTTP_PARSE_ERROR;
+    return HTTP_PARSE_NEED_MORE;
+}
+
+enum {
+    P_METHOD = 0,
+    P_TARGET_START,
+    P_TARGET,
+    P_VERSION,
+    P_HEADER_START,
+    P_HEADER_NAME,
+    P_HEADER_VALUE_WS,
+    P_HEADER_VALUE,
+    P_HEADER_LF,
+    P_HEAD_END_LF,
+    P_BODY,
+    P_CHUNKED,
+    P_DONE,
+    P_ERROR
+};
+
+#define NO_QUERY    UINT32_MAX
+#define OFF(ptr)    ((uint32_t)((ptr) - buf))
+
+void http_parser_init(http_parser_t *parser)
+{
+    http_request_t *req = &parser->req;
+
+    parser->pos   = 0;
+    parser->mark  = 0;
+    parser->mark2 = NO_QUERY;
+    parser->state = P_METHOD;
+    parser->error = Ok;
+
+    /* headers[] is only valid up to header_count; leave it alone. */
+    memset(req, 0, offsetof(http_request_t, headers));
+    memset(req->known, 0xff, sizeof(req->known));
+    req->method_code = METHOD_COUNT;
+}
+
+int http_parser_head_done(const http_parser_t *parser)
+{
+    return parser->state == P_BODY || parser->state == P_CHUNKED || parser->state == P_DONE;
+}
+
+static http_parse_status parse_fail(http_parser_t *parser, http_error_code error, const char *why)
+{
+    log_write(LOG_DEBUG, "%s\n", why);
+    parser->state = P_ERROR;
+    parser->error = (uint16_t)error;
+    return HTTP_PARSE_ERROR;
+}
+
+/* A complete header line was scanned: classify it and store it. */
+static http_parse_status commit_header(http_parser_t *parser, const char *buf)
+{
+    http_request_t *req = &parser->req;
+    http_header_t  *hdr = &req->headers[req->header_count];
+
+    *hdr = parser->cur;
+    hdr->id = http_header_lookup(buf + hdr->name.off, hdr->name.len);
+
+    if (hdr->id == HDR_CONTENT_LENGTH)
+    {
+        /* A second Content-Length is a request smuggling vector. */
+        if (req->has_content_length)
+            return parse_fail(parser, Bad_Request, "Duplicate Content-Length");
+
+        http_error_code error = http_parse_content_length(buf + hdr->value.off, hdr->value.len,
+                                                          &req->content_length);
+        if (error != Ok)
+            return parse_fail(parser, error, "Bad Content-Length");
+        req->has_content_length = 1;
+    }
+
+    if (hdr->id == HDR_TRANSFER_ENCODING)
+    {
+        /* Only a lone "chunked" is understood; any other coding would
+           leave the body length unknown (RFC 9112 6.1). */
+        if (req->chunked)
+            return parse_fail(parser, Bad_Request, "Duplicate Transfer-Encoding");
+        if (hdr->value.len != 7 || strncasecmp(buf + hdr->value.off, "chunked", 7) != 0)
+            return parse_fail(parser, Not_Implemented, "Unsupported Transfer-Encoding");
+        req->chunked = 1;
+    }
+
+    if (hdr->id != HDR_UNKNOWN && req->known[hdr->id] < 0)
+        req->known[hdr->id] = (int16_t)req->header_count;
+    req->header_count++;
+    return HTTP_PARSE_NEED_MORE;
+}
+
+http_parse_status http_parser_execute(http_parser_t *parser, const char *buf, size_t length)
+{
+    if (parser->state == P_DONE)  return HTTP_PARSE_DONE;
+    if (parser->state == P_ERROR) return HTTP_PARSE_ERROR;
+    if (length > UINT32_MAX)
+        return parse_fail(parser, Content_Too_Large, "Request larger than 4 GB");
+
+    http_request_t *req = &parser->req;
+    const char *p   = buf + parser->pos;
+    const char *end = buf + length;
+
+    for (;;)
+    {
+        switch (parser->state)
+        {
+        /* Request line: METHOD SP /TARGET SP HTTP/D.D CRLF */
+
+        case P_METHOD:
+            /* Method: one or more uppercase ASCII letters */
+            while (p < end && *p >= 'A' && *p <= 'Z') p++;
+            if (p == end) goto need_more;
+            if (*p != ' ' || OFF(p) == parser->mark)
+                return parse_fail(parser, Bad_Request, "Bad Request Line (method)");
+
+            req->method.off = parser->mark;
+            req->method.len = OFF(p) - parser->mark;
+            req->method_code = (uint8_t)http_method_lookup(buf + req->method.off, req->method.len);
+            p++; /* skip SP */
+            parser->state = P_TARGET_START;
+            /* fallthrough */
+
+        case P_TARGET_START:
+            /* Target: leading '/' (not included in the target slice) */
+            if (p == end) goto need_more;
+            if (*p != '/')
+                return parse_fail(parser, Bad_Request, "Bad Request Line (target)");
+            p++;
+            parser->mark  = OFF(p);
+            parser->mark2 = NO_QUERY;
+            parser->state = P_TARGET;
+            /* fallthrough */
+
+        case P_TARGET:
+            for (;;)
+            {
+                p = g_scan.target_end(p, end);
+                if (p == end) goto need_more;
+                if (*p != '?') break;
+                if (parser->mark2 == NO_QUERY) parser->mark2 = OFF(p);
+                p++;
+            }
+            if (*p != ' ')
+                return parse_fail(parser, Bad_Request, "Bad Request Line (target terminator)");
+
+            if (parser->mark2 != NO_QUERY)
+            {
+                req->target = (http_slice_t){ parser->mark, parser->mark2 - parser->mark };
+                req->query  = (http_slice_t){ parser->mark2 + 1, OFF(p) - parser->mark2 - 1 };
+            }
+            else
+            {
+                req->target = (http_slice_t){ parser->mark, OFF(p) - parser->mark };
+                req->query  = (http_slice_t){ OFF(p), 0 };
+            }
+            p++; /* skip SP */
+            parser->state = P_VERSION;
+            /* fallthrough */
+
+        case P_VERSION:
+            /* Fixed width "HTTP/D.D\r\n": wait until all of it is here. */
+            if (end - p < 10)
+            {
+                size_t have = (size_t)(end - p);
+                if (memcmp(p, "HTTP/", have < 5 ? have : 5) != 0)
+                    return parse_fail(parser, Bad_Request, "Bad Request Line (version prefix)");
+                goto need_more;
+            }
+            if (memcmp(p, "HTTP/", 5) != 0)
+                return parse_fail(parser, Bad_Request, "Bad Request Line (version prefix)");
+            if (p[5] < '0' || p[5] > '9' || p[6] != '.' || p[7] < '0' || p[7] > '9')
+                return parse_fail(parser, Bad_Request, "Bad Request Line (version digits)");
+            if (p[8] != '\r' || p[9] != '\n')
+                return parse_fail(parser, Bad_Request, "Bad Request Line (CRLF)");
+
+            req->http_major_version = (uint8_t)(p[5] - '0');
+            req->http_minor_version = (uint8_t)(p[7] - '0');
+            p += 10;
+            parser->state = P_HEADER_START;
+            /* fallthrough */
+
+        /* Header fields: NAME ":" OWS VALUE OWS CRLF, until an empty line */
+
+        case P_HEADER_START:
+            if (p == end) goto need_more;
+            if (*p == '\r')
+            {
+                p++;
+                parser->state = P_HEAD_END_LF;
+                break;
+            }
+            if (req->header_count == HTTP_MAX_HEADERS)
+                return parse_fail(parser, Bad_Request, "Too many header fields");
+
+            parser->cur.name.off = OFF(p);
+            parser->state = P_HEADER_NAME;
+            /* fallthrough */
+
+        case P_HEADER_NAME:
+            p = g_scan.name_end(p, end);
+            if (p == end) goto need_more;
+            if (*p != ':' || OFF(p) == parser->cur.name.off)
+                return parse_fail(parser, Bad_Request, "Bad header field name");
+
+            parser->cur.name.len = OFF(p) - parser->cur.name.off;
+            p++; /* skip ':' */
+            parser->state = P_HEADER_VALUE_WS;
+            /* fallthrough */
+
+        case P_HEADER_VALUE_WS:
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            if (p == end) goto need_more;
+
+            parser->cur.value.off = OFF(p);
+            parser->state = P_HEADER_VALUE;
+            /* fallthrough */
+
+        case P_HEADER_VALUE:
+        {
+            p = g_scan.value_end(p, end);
+            if (p == end) goto need_more;
+            if (*p == '\n')
+                return parse_fail(parser, Bad_Request, "Bare LF in header field");
+            if (*p != '\r')
+                return parse_fail(parser, Bad_Request, "Control character in header field");
+
+            const char *value     = buf + parser->cur.value.off;
+            const char *value_end = p;
+            while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+            parser->cur.value.len = (uint32_t)(value_end - value);
+
+            p++; /* skip CR */
+            parser->state = P_HEADER_LF;
+        }
+            /* fallthrough */
+
+        case P_HEADER_LF:
+            if (p == end) goto need_more;
+            if (*p != '\n')
+                return parse_fail(parser, Bad_Request, "Didn't find CRLF at the end of line");
+            p++;
+
+            if (commit_header(parser, buf) == HTTP_PARSE_ERROR)
+                return HTTP_PARSE_ERROR;
+            parser->state = P_HEADER_START;
+            break;
+
+        case P_HEAD_END_LF:
+            if (p == end) goto need_more;
+            if (*p != '\n')
+                return parse_fail(parser, Bad_Request, "Didn't find CRLF at the end of headers");
+            p++;
+
+            req->head_len = OFF(p);
+            req->body     = (http_slice_t){ OFF(p), 0 };
+
+            if (req->chunked)
+            {
+                /* Both framings at once is a request smuggling vector, and
+                   HTTP/1.0 has no chunked coding. */
+                if (req->has_content_length)
+                    return parse_fail(parser, Bad_Request, "Content-Length with Transfer-Encoding");
+                if (req->http_major_version == 1 && req->http_minor_version == 0)
+                    return parse_fail(parser, Bad_Request, "Transfer-Encoding in HTTP/1.0");
+                http_chunked_init(&parser->chunked);
+                parser->state = P_CHUNKED;
+                break;
+            }
+            parser->state = P_BODY;
+            /* fallthrough */
+
+        case P_BODY:
+        {
+            /* Body: exactly Content-Length bytes after the head. */
+            uint64_t missing = req->content_length - req->body.len;
+            size_t   take    = ((uint64_t)(end - p) < missing) ? (size_t)(end - p) : (size_t)missing;
+            p             += take;
+            req->body.len += (uint32_t)take;
+            if (req->body.len < req->content_length) goto need_more;
+
+            parser->pos   = OFF(p);
+            parser->state = P_DONE;
+            return HTTP_PARSE_DONE;
+        }
+
+        case P_CHUNKED:
+        {
+            /* Only the framing is checked here: the body slice keeps it and
+               whoever reads the body decodes it. */
+            size_t used, produced;
+            http_parse_status st = http_chunked_decode(&parser->chunked, p, (size_t)(end - p),
+                                                       NULL, &used, &produced);
+            p                  += used;
+            req->body.len      += (uint32_t)used;
+            req->content_length = parser->chunked.total;
+            if (st == HTTP_PARSE_ERROR)
+                return parse_fail(parser, Bad_Request, "Bad chunked body");
+            if (st == HTTP_PARSE_NEED_MORE) goto need_more;
+
+            parser->pos   = OFF(p);
+            parser->state = P_DONE;
+            return HTTP_PARSE_DONE;
+        }
+
+        default:
+            return (parser->state == P_DONE) ? HTTP_PARSE_DONE : HTTP_PARSE_ERROR;
+        }
+    }
+
+need_more:
+    parser->pos = OFF(p);
+    return HTTP_PARSE_NEED_MORE;
+}
+
+http_error_code http_request_parse(const char *buf, size_t length, http_request_t *req)
+{
+    if (buf == NULL || req == NULL)
+        return Internal_Server_Error;
+
+    http_parser_t parser;
+    http_parser_init(&parser);
+
+    http_error_code error;
+    switch (http_parser_execute(&parser, buf, length))
+    {
+    case HTTP_PARSE_DONE:  error = Ok;                          break;
+    case HTTP_PARSE_ERROR: return (http_error_code)parser.error;
+    default:
+        if (!http_parser_head_done(&parser))
+        {
+            log_write(LOG_DEBUG, "Didn't find CRLF at the end of line\n");
+            return Bad_Request;
+        }
+        error = No_Content;
+        break;
+    }
+
+    memcpy(req, &parser.req, offsetof(http_request_t, headers) +
+                             parser.req.header_count * sizeof(http_header_t));
+    return error;
+}
+
+const http_header_t *http_request_header(const http_request_t *req, header_id id)
+{
+    if (id >= HDR_UNKNOWN || req->known[id] < 0) return NULL;
+    return &req->headers[req->known[id]];
+}
+
+const http_header_t *http_request_find(const http_request_t *req, const char *buf,
+                                       const char *name, size_t name_len)
+{
+    for (uint16_t i = 0; i < req->header_count; i++)
+    {
+        const http_header_t *hdr = &req->headers[i];
+        if (hdr->name.len == name_len &&
+            strncasecmp(buf + hdr->name.off, name, name_len) == 0)
+            return hdr;
+    }
+    return NULL;
+}
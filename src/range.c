@@ -0,0 +1,94 @@
+#include <strings.h>
+#include "../include/range.h"
+
+/* Digits into *out; 0 if there are none or they overflow. */
+static int parse_pos(const char **p, const char *end, uint64_t *out)
+{
+    const char *s = *p;
+    uint64_t v = 0;
+
+    while (s < end && *s >= '0' && *s <= '9')
+    {
+        unsigned d = (unsigned)(*s - '0');
+        if (v > (UINT64_MAX - d) / 10) return 0;
+        v = v * 10 + d;
+        s++;
+    }
+    if (s == *p) return 0;
+    *p   = s;
+    *out = v;
+    return 1;
+}
+
+static void skip_ows(const char **p, const char *end)
+{
+    while (*p < end && (**p == ' ' || **p == '\t')) (*p)++;
+}
+
+int range_parse(const char *value, size_t length, uint64_t size, byte_range_t ranges[RANGE_MAX])
+{
+    const char *p   = value;
+    const char *end = value + length;
+    int count = 0;
+    int specs = 0;
+
+    if (length < 6 || strncasecmp(p, "bytes=", 6) != 0) return -1;
+    p += 6;
+
+    while (p < end)
+    {
+        skip_ows(&p, end);
+        if (p < end && *p == ',') { p++; continue; }     /* empty list elements */
+        if (p == end) break;
+
+        uint64_t first = 0, last = 0;
+        int has_first = parse_pos(&p, end, &first);
+        if (p == end || *p != '-') return -1;
+        p++;
+        int has_last = parse_pos(&p, end, &last);
+        skip_ows(&p, end);
+        if (p < end && *p != ',') return -1;
+
+        if (!has_first && !has_last) return -1;
+        if (has_first && has_last && last < first) return -1;
+        if (++specs > RANGE_MAX) return -1;
+
+        if (!has_first)                 /* suffix: the final `last` bytes */
+        {
+            if (last == 0 || size == 0) continue;
+            first = (last >= size) ? 0 : size - last;
+            last  = size - 1;
+        }
+        else
+        {
+            if (first >= size) continue;
+            if (!has_last || last >= size) last = size - 1;
+        }
+
+        ranges[count].first = first;
+        ranges[count].last  = last;
+        count++;
+    }
+    if (specs == 0) return -1;
+
+    /* Sort by start (a handful at most) and merge. */
+    for (int i = 1; i < count; i++)
+    {
+        byte_range_t r = ranges[i];
+        int j = i;
+        while (j > 0 && ranges[j - 1].first > r.first) { ranges[j] = ranges[j - 1]; j--; }
+        ranges[j] = r;
+    }
+
+    int merged = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (merged > 0 && ranges[i].first <= ranges[merged - 1].last + 1)
+        {
+            if (ranges[i].last > ranges[merged - 1].last) ranges[merged - 1].last = ranges[i].last;
+            continue;
+        }
+        ranges[merged++] = ranges[i];
+    }
+    return merged;
+}
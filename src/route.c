@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/hash.h"
+#include "../include/route.h"
+
+/*----------------------------------------------*/
+/*                Exact names                   */
+/*----------------------------------------------*/
+
+route_index_t *route_index_create(unsigned int exact_count)
+{
+    route_index_t *index = calloc(1, sizeof(route_index_t));
+    if (index == NULL) return NULL;
+
+    unsigned int capacity = 8;
+    while (capacity < 2 * exact_count) capacity <<= 1;
+
+    index->exact_keys     = calloc(capacity, sizeof(char *));
+    index->exact_ids      = calloc(capacity, sizeof(int32_t));
+    index->exact_capacity = capacity;
+    index->prefixes       = calloc(1, sizeof(radix_node_t));
+    if (index->exact_keys == NULL || index->exact_ids == NULL || index->prefixes == NULL)
+    {
+        route_index_free(index);
+        return NULL;
+    }
+
+    index->prefixes->label    = strdup("");
+    index->prefixes->resource = -1;
+    if (index->prefixes->label == NULL)
+    {
+        route_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+int route_add_exact(route_index_t *index, const char *name, int32_t id)
+{
+    /* Sized up front, so this only trips on more names than announced. */
+    if (2 * (index->exact_count + 1) > index->exact_capacity) return -1;
+
+    unsigned int mask = index->exact_capacity - 1;
+    unsigned int slot = hash_index(name, (int)index->exact_capacity);
+
+    while (index->exact_keys[slot] != NULL)
+    {
+        if (strcmp(index->exact_keys[slot], name) == 0) return 1;
+        slot = (slot + 1) & mask;
+    }
+
+    index->exact_keys[slot] = strdup(name);
+    if (index->exact_keys[slot] == NULL) return -1;
+    index->exact_ids[slot] = id;
+    index->exact_count++;
+    return 0;
+}
+
+int32_t route_find_exact(const route_index_t *index, const char *target)
+{
+    unsigned int mask = index->exact_capacity - 1;
+    unsigned int slot = hash_index(target, (int)index->exact_capacity);
+
+    /* Load factor <= 1/2 guarantees an empty slot ends the probe. */
+    while (index->exact_keys[slot] != NULL)
+    {
+        if (strcmp(index->exact_keys[slot], target) == 0) return index->exact_ids[slot];
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+/*----------------------------------------------*/
+/*             Directory prefixes               */
+/*----------------------------------------------*/
+
+static radix_node_t *node_new(const char *label, size_t label_len, int32_t resource)
+{
+    radix_node_t *node = calloc(1, sizeof(radix_node_t));
+    if (node == NULL) return NULL;
+
+    node->label = strndup(label, label_len);
+    if (node->label == NULL) { free(node); return NULL; }
+    node->label_len = (uint32_t)label_len;
+    node->resource  = resource;
+    return node;
+}
+
+static void node_free(radix_node_t *node)
+{
+    for (uint16_t i = 0; i < node->child_count; i++)
+        node_free(node->children[i]);
+    free(node->children);
+    free(node->first);
+    free(node->label);
+    free(node);
+}
+
+static int node_add_child(radix_node_t *parent, radix_node_t *child)
+{
+    size_t n = (size_t)parent->child_count + 1;
+
+    radix_node_t **children = realloc(parent->children, n * sizeof(radix_node_t *));
+    if (children == NULL) return -1;
+    parent->children = children;
+
+    unsigned char *first = realloc(parent->first, n);
+    if (first == NULL) return -1;
+    parent->first = first;
+
+    parent->children[n - 1] = child;
+    parent->first[n - 1]    = (unsigned char)child->label[0];
+    parent->child_count     = (uint16_t)n;
+    return 0;
+}
+
+static int node_child(const radix_node_t *node, unsigned char c)
+{
+    for (uint16_t i = 0; i < node->child_count; i++)
+        if (node->first[i] == c) return i;
+    return -1;
+}
+
+int route_add_prefix(route_index_t *index, const char *name, int32_t id)
+{
+    radix_node_t *node = index->prefixes;
+    const char   *key  = (strcmp(name, ".") == 0) ? "" : name;
+
+    while (*key != '\0')
+    {
+        int i = node_child(node, (unsigned char)*key);
+        if (i < 0)
+        {
+            radix_node_t *leaf = node_new(key, strlen(key), id);
+            if (leaf == NULL) return -1;
+            if (node_add_child(node, leaf) != 0) { node_free(leaf); return -1; }
+            return 0;
+        }
+
+        radix_node_t *child = node->children[i];
+        uint32_t common = 0;
+        while (common < child->label_len && key[common] != '\0' && key[common] == child->label[common])
+            common++;
+
+        if (common < child->label_len)
+        {
+            /* Split the edge: parent -> mid (shared part) -> child (rest). */
+            radix_node_t *mid = node_new(child->label, common, -1);
+            if (mid == NULL) return -1;
+
+            char *rest = strdup(child->label + common);
+            if (rest == NULL || node_add_child(mid, child) != 0) { free(rest); node_free(mid); return -1; }
+            free(child->label);
+            child->label     = rest;
+            child->label_len -= common;
+            mid->first[0]    = (unsigned char)rest[0];
+
+            node->children[i] = mid;
+            child = mid;
+        }
+
+        node = child;
+        key += common;
+    }
+
+    if (node->resource >= 0) return 1;
+    node->resource = id;
+    return 0;
+}
+
+int32_t route_find_prefix(const route_index_t *index, const char *target)
+{
+    const radix_node_t *node = index->prefixes;
+    const char *p = target;
+
+    /* The root ("." in resources.conf) matches every target. */
+    int32_t best = node->resource;
+
+    for (;;)
+    {
+        int i = node_child(node, (unsigned char)*p);
+        if (i < 0) break;
+
+        node = node->children[i];
+        if (strncmp(p, node->label, node->label_len) != 0) break;
+        p += node->label_len;
+
+        /* A prefix only counts if it ends on a component boundary. */
+        if (node->resource >= 0 && (*p == '\0' || *p == '/'))
+            best = node->resource;
+    }
+    return best;
+}
+
+void route_index_free(route_index_t *index)
+{
+    if (index == NULL) return;
+
+    if (index->exact_keys != NULL)
+    {
+        for (unsigned int i = 0; i < index->exact_capacity; i++)
+            free((void *)index->exact_keys[i]);
+    }
+    free(index->exact_keys);
+    free(index->exact_ids);
+    if (index->prefixes != NULL) node_free(index->prefixes);
+    free(index);
+}
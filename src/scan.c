@@ -0,0 +1,253 @@
+#include <stdint.h>
+#include <string.h>
+#include "../include/scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* Byte classes for the scalar kernels and the tail of the vector ones. */
+#define C_NAME_STOP     0x01
+#define C_VALUE_STOP    0x02
+#define C_TARGET_STOP   0x04
+
+static uint8_t g_class[256];
+static uint8_t g_lower[256];
+
+static void tables_init(void)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        uint8_t cls = 0;
+        int ctl = (c < 0x20 || c == 0x7f);
+
+        if (ctl || c == ' ' || c == ':')  cls |= C_NAME_STOP;
+        if (ctl && c != '\t')             cls |= C_VALUE_STOP;
+        if (ctl || c == ' ' || c == '?')  cls |= C_TARGET_STOP;
+
+        g_class[c] = cls;
+        g_lower[c] = (uint8_t)((c >= 'A' && c <= 'Z') ? c + 32 : c);
+    }
+}
+
+static inline const char *find_class(const char *p, const char *end, uint8_t cls)
+{
+    while (p < end && !(g_class[(uint8_t)*p] & cls)) p++;
+    return p;
+}
+
+/*----------------------------------------------*/
+/*                  Scalar                      */
+/*----------------------------------------------*/
+
+static const char *name_end_scalar(const char *p, const char *end)
+{
+    return find_class(p, end, C_NAME_STOP);
+}
+
+static const char *value_end_scalar(const char *p, const char *end)
+{
+    return find_class(p, end, C_VALUE_STOP);
+}
+
+static const char *target_end_scalar(const char *p, const char *end)
+{
+    return find_class(p, end, C_TARGET_STOP);
+}
+
+static void lower_scalar(char *dst, const char *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = (char)g_lower[(uint8_t)src[i]];
+}
+
+#ifdef SCAN_X86
+
+/*----------------------------------------------*/
+/*                  SSE4.2                      */
+/*----------------------------------------------*/
+
+/* PCMPESTRI in "ranges" mode: index of the first byte falling in one of
+   the [lo, hi] pairs of `ranges`, 16 if none. */
+#define SSE42_FIND(NAME, RANGES, CLASS)                                             \
+__attribute__((target("sse4.2")))                                                  \
+static const char *NAME(const char *p, const char *end)                           \
+{                                                                                   \
+    static const char ranges[16] __attribute__((aligned(16))) = RANGES;            \
+    const __m128i r = _mm_load_si128((const __m128i *)ranges);                     \
+    const int     rlen = (int)sizeof(RANGES) - 1;                                  \
+                                                                                    \
+    while (end - p >= 16)                                                           \
+    {                                                                               \
+        __m128i b = _mm_loadu_si128((const __m128i *)p);                           \
+        int idx = _mm_cmpestri(r, rlen, b, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | \
+                                               _SIDD_LEAST_SIGNIFICANT);            \
+        if (idx != 16) return p + idx;                                              \
+        p += 16;                                                                    \
+    }                                                                               \
+    return find_class(p, end, CLASS);                                               \
+}
+
+SSE42_FIND(name_end_sse42,   "\x00\x20" "::" "\x7f\x7f",           C_NAME_STOP)
+SSE42_FIND(value_end_sse42,  "\x00\x08" "\x0a\x1f" "\x7f\x7f",     C_VALUE_STOP)
+SSE42_FIND(target_end_sse42, "\x00\x20" "??" "\x7f\x7f",           C_TARGET_STOP)
+
+/* 'A'..'Z' is the only range that changes; signed compares are fine since
+   bytes >= 0x80 are negative and never match. */
+__attribute__((target("sse4.2")))
+static void lower_sse42(char *dst, const char *src, size_t n)
+{
+    const __m128i lo   = _mm_set1_epi8('A' - 1);
+    const __m128i hi   = _mm_set1_epi8('Z' + 1);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i b     = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(b, lo), _mm_cmplt_epi8(b, hi));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(b, _mm_and_si128(upper, flip)));
+    }
+    lower_scalar(dst + i, src + i, n - i);
+}
+
+/*----------------------------------------------*/
+/*                  AVX2                        */
+/*----------------------------------------------*/
+
+/* Bytes <= limit (unsigned), as a compare mask. */
+__attribute__((target("avx2")))
+static inline __m256i le_epu8(__m256i b, __m256i limit)
+{
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(b, limit), b);
+}
+
+__attribute__((target("avx2")))
+static const char *name_end_avx2(const char *p, const char *end)
+{
+    const __m256i sp    = _mm256_set1_epi8(' ');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i del   = _mm256_set1_epi8(0x7f);
+
+    while (end - p >= 32)
+    {
+        __m256i b = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_or_si256(le_epu8(b, sp),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(b, colon), _mm256_cmpeq_epi8(b, del)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_class(p, end, C_NAME_STOP);
+}
+
+__attribute__((target("avx2")))
+static const char *value_end_avx2(const char *p, const char *end)
+{
+    const __m256i us  = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+
+    while (end - p >= 32)
+    {
+        __m256i b   = _mm256_loadu_si256((const __m256i *)p);
+        __m256i ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), le_epu8(b, us));
+        __m256i m   = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(b, del));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_class(p, end, C_VALUE_STOP);
+}
+
+__attribute__((target("avx2")))
+static const char *target_end_avx2(const char *p, const char *end)
+{
+    const __m256i sp    = _mm256_set1_epi8(' ');
+    const __m256i qmark = _mm256_set1_epi8('?');
+    const __m256i del   = _mm256_set1_epi8(0x7f);
+
+    while (end - p >= 32)
+    {
+        __m256i b = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_or_si256(le_epu8(b, sp),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(b, qmark), _mm256_cmpeq_epi8(b, del)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_class(p, end, C_TARGET_STOP);
+}
+
+__attribute__((target("avx2")))
+static void lower_avx2(char *dst, const char *src, size_t n)
+{
+    const __m256i lo   = _mm256_set1_epi8('A' - 1);
+    const __m256i hi   = _mm256_set1_epi8('Z' + 1);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i b     = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(b, lo), _mm256_cmpgt_epi8(hi, b));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(b, _mm256_and_si256(upper, flip)));
+    }
+    lower_scalar(dst + i, src + i, n - i);
+}
+
+#endif // SCAN_X86
+
+/*----------------------------------------------*/
+/*                  Dispatch                    */
+/*----------------------------------------------*/
+
+static const scan_ops_t g_ops[] =
+{
+    [SCAN_SCALAR] = { name_end_scalar, value_end_scalar, target_end_scalar, lower_scalar },
+#ifdef SCAN_X86
+    [SCAN_SSE42]  = { name_end_sse42,  value_end_sse42,  target_end_sse42,  lower_sse42  },
+    [SCAN_AVX2]   = { name_end_avx2,   value_end_avx2,   target_end_avx2,   lower_avx2   },
+#endif
+};
+
+/* The tables are built before main() so the scalar defaults below are
+   usable even if scan_init() never runs. */
+__attribute__((constructor))
+static void scan_tables_ctor(void)
+{
+    tables_init();
+}
+
+scan_ops_t g_scan = { name_end_scalar, value_end_scalar, target_end_scalar, lower_scalar };
+
+static scan_impl_t best_impl(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))   return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SCAN_SSE42;
+#endif
+    return SCAN_SCALAR;
+}
+
+scan_impl_t scan_init(int force)
+{
+    scan_impl_t impl = best_impl();
+    if (force >= 0 && (scan_impl_t)force < impl)
+        impl = (scan_impl_t)force;
+
+    g_scan = g_ops[impl];
+    return impl;
+}
+
+const char *scan_impl_name(scan_impl_t impl)
+{
+    switch (impl)
+    {
+    case SCAN_AVX2:  return "avx2";
+    case SCAN_SSE42: return "sse4.2";
+    default:         return "scalar";
+    }
+}
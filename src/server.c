@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <fcntl.h>
@@ -6,31 +8,80 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
-#include <sys/sendfile.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "../include/file_cache.h"
+#include "../include/gzip.h"
+#include "../include/metrics.h"
+#include "../include/parser.h"
+#include "../include/range.h"
 #include "../include/server.h"
+#include "../include/route.h"
+#include "../include/uring.h"
 
 resource_t *g_resources     = NULL;
 size_t      g_resource_count = 0;
 
-static const struct { const char *str; content_type_t type; } ext_map[] = {
-    {"html", HTML}, {"text", TEXT}, {"txt",  TEXT},
-    {"js",   JS},   {"css",  CSS},  {"json", JSON},
-    {"png",  PNG},  {"svg",  SVG},  {"wasm", WASM},
-    {"otf",  OTF},  {"bin",  BIN},  {"frag", BIN}
-};
+static route_index_t *g_routes = NULL;
+
+file_cache_t g_file_cache;
+file_cache_t g_gzip_cache;
+int          g_gzip_level    = GZIP_DEFAULT_LEVEL;
+size_t       g_gzip_stream_max = GZIP_DEFAULT_STREAM_MAX;
+
+/* Index the table: exact names for files, prefixes for directories. On a
+   duplicate the first entry wins, as with the old linear scan. */
+static route_index_t *build_routes(const resource_t *table, size_t count)
+{
+    route_index_t *routes = route_index_create((unsigned int)count);
+    if (routes == NULL) return NULL;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int r = table[i].is_directory ? route_add_prefix(routes, table[i].name, (int32_t)i)
+                                      : route_add_exact(routes, table[i].name, (int32_t)i);
+        if (r < 0)
+        {
+            route_index_free(routes);
+            return NULL;
+        }
+        if (r > 0)
+            log_write(LOG_INFO, "Duplicate resource \"%s\" ignored\n", table[i].name);
+    }
+    return routes;
+}
 
 static content_type_t content_type_from_path(const char *path)
 {
     const char *dot = strrchr(path, '.');
     if (dot == NULL) return BIN;
     dot++;
-    for (size_t i = 0; i < sizeof(ext_map)/sizeof(ext_map[0]); i++)
-        if (strcmp(dot, ext_map[i].str) == 0)
-            return ext_map[i].type;
-    return BIN;
+    content_type_t type = http_extension_lookup(dot, strlen(dot));
+    return (type != MAX_EXTENSION) ? type : BIN;
+}
+
+/* A byte count with an optional k, m or g suffix (powers of 1024). */
+static int parse_size(const char *text, uint64_t *bytes)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-') return -1;
+
+    unsigned shift = 0;
+    switch (*end)
+    {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || v > (UINT64_MAX >> shift)) return -1;
+
+    *bytes = (uint64_t)v << shift;
+    return 0;
 }
 
 int load_resources(const char *config_path)
@@ -45,12 +96,12 @@ int load_resources(const char *config_path)
 
     while (fgets(line, sizeof(line), f))
     {
-        line[strcspn(line, "\n")] = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
         if (line[0] == '#' || line[0] == '\0') continue;
 
         char name[64], filename[256], ext_str[32], methods_str[64];
-        char require_body_str[4] = "0";
-        int fields = sscanf(line, "%63s %255s %31s %63s %3s", name, filename, ext_str, methods_str, require_body_str);
+        int consumed = 0;
+        int fields = sscanf(line, "%63s %255s %31s %63s%n", name, filename, ext_str, methods_str, &consumed);
         if (fields < 4) continue;
 
         if (count == capacity)
@@ -68,68 +119,160 @@ int load_resources(const char *config_path)
         table[count].filename[sizeof(table[count].filename) - 1] = '\0';
 
         table[count].is_directory  = (strcmp(ext_str, "dir") == 0) ? 1 : 0;
-        table[count].require_body  = (strcmp(require_body_str, "1") == 0) ? 1 : 0;
-        table[count].extension = HTML;
-        if (!table[count].is_directory)
+        table[count].builtin       = (strcmp(ext_str, "metrics") == 0) ? BUILTIN_METRICS : BUILTIN_NONE;
+        table[count].require_body  = 0;
+        table[count].cache_control[0] = '\0';
+        table[count].max_body      = RESOURCE_DEFAULT_MAX_BODY;
+        table[count].fsync_policy  = FSYNC_FILE;
+
+        /* Optional trailing fields: a bare 0/1 is require_body, anything
+           else is key=value. */
+        char *save = NULL;
+        for (char *opt = strtok_r(line + consumed, " \t", &save); opt != NULL; opt = strtok_r(NULL, " \t", &save))
         {
-            for (size_t i = 0; i < sizeof(ext_map)/sizeof(ext_map[0]); i++)
+            if (strcmp(opt, "0") == 0 || strcmp(opt, "1") == 0)
+                table[count].require_body = (opt[0] == '1') ? 1 : 0;
+            else if (strncmp(opt, "max_body=", 9) == 0)
             {
-                if (strcmp(ext_str, ext_map[i].str) == 0)
-                {
-                    table[count].extension = ext_map[i].type;
-                    break;
-                }
+                uint64_t bytes;
+                if (parse_size(opt + 9, &bytes) == 0) table[count].max_body = bytes;
+                else log_write(LOG_ERROR, "%s: %s: bad size '%s'\n", config_path, name, opt + 9);
             }
+            else if (strcmp(opt, "fsync=none") == 0) table[count].fsync_policy = FSYNC_NONE;
+            else if (strcmp(opt, "fsync=file") == 0) table[count].fsync_policy = FSYNC_FILE;
+            else if (strcmp(opt, "fsync=full") == 0) table[count].fsync_policy = FSYNC_FULL;
+            else if (strncmp(opt, "cache_control=", 14) == 0)
+                snprintf(table[count].cache_control, sizeof(table[count].cache_control), "%s", opt + 14);
+            else
+                log_write(LOG_ERROR, "%s: %s: unknown option '%s'\n", config_path, name, opt);
+        }
+        table[count].extension = HTML;
+        if (!table[count].is_directory)
+        {
+            content_type_t type = http_extension_lookup(ext_str, strlen(ext_str));
+            if (type != MAX_EXTENSION) table[count].extension = type;
         }
 
         table[count].allowed_methods = 0;
         char *token = strtok(methods_str, ",");
         while (token != NULL)
         {
-            for (int j = 0; j < METHOD_COUNT; j++)
-            {
-                if (strcmp(token, http_methods_name[j]) == 0)
-                {
-                    table[count].allowed_methods |= (uint8_t)(1 << j);
-                    break;
-                }
-            }
+            http_methods_code method = http_method_lookup(token, strlen(token));
+            if (method != METHOD_COUNT)
+                table[count].allowed_methods |= (uint8_t)(1 << method);
             token = strtok(NULL, ",");
         }
+        /* Nothing to upload to. */
+        if (table[count].builtin != BUILTIN_NONE)
+            table[count].allowed_methods &= (uint8_t)(1 << GET);
 
-        pthread_rwlock_init(&table[count].rwlock, NULL);
+        pthread_mutex_init(&table[count].commit_lock, NULL);
+        table[count].generation = 0;
         count++;
     }
 
     fclose(f);
+
+    route_index_t *routes = build_routes(table, count);
+    if (routes == NULL)
+    {
+        for (size_t i = 0; i < count; i++) pthread_mutex_destroy(&table[i].commit_lock);
+        free(table);
+        return -1;
+    }
+
     free_resources();
     g_resources      = table;
     g_resource_count = count;
+    g_routes         = routes;
     return 0;
 }
 
 void free_resources(void)
 {
     for (size_t i = 0; i < g_resource_count; i++)
-        pthread_rwlock_destroy(&g_resources[i].rwlock);
+        pthread_mutex_destroy(&g_resources[i].commit_lock);
     free(g_resources);
+    route_index_free(g_routes);
     g_resources      = NULL;
     g_resource_count = 0;
+    g_routes         = NULL;
+}
+
+/* Request-scoped memory: from the message's arena when it has one (freed
+   in one step by http_message_free), from the heap otherwise. */
+static void *msg_alloc(http_message_t *message, size_t size)
+{
+    return (message->arena != NULL) ? arena_alloc(message->arena, size) : malloc(size);
+}
+
+static char *msg_strndup(http_message_t *message, const char *src, size_t length)
+{
+    return (message->arena != NULL) ? arena_strndup(message->arena, src, length)
+                                    : strstrcpy(src, length);
+}
+
+static void msg_free(http_message_t *message, void *ptr)
+{
+    if (message->arena == NULL) free(ptr);
+}
+
+/* q=0, 0.0, 0.00 or 0.000 means "not acceptable"; anything else accepts. */
+static int qvalue_is_zero(const char *p, const char *end)
+{
+    if (p == end || *p != '0') return 0;
+    p++;
+    if (p < end && *p == '.')
+        for (p++; p < end && *p == '0'; p++) ;
+    return p == end;
 }
 
-const char *known_headers[HDR_UNKNOWN] = 
+/* Fold one Accept-Encoding list into `ae`. "*" stands for gzip and deflate
+   unless they are listed themselves; identity is always acceptable. */
+static void parse_accept_encoding(const char *field, size_t field_size, hdr_accept_enconding_t *ae)
 {
-    [HDR_HOST]             = "host",
-    [HDR_CONNECTION]       = "connection",
-    [HDR_CONTENT_LENGTH]   = "content-length",
-    [HDR_USER_AGENT]       = "user-agent",
-    [HDR_CONTENT_TYPE]     = "content-type",
-    [HDR_ACCEPT]           = "accept",
-    [HDR_ORIGIN]           = "origin",
-    [HDR_REFERER]          = "referer",
-    [HDR_ACCEPT_ENCODING]  = "accept-encoding",
-    [HDR_ACCEPT_LANGUAGE]  = "accept-language"
-};
+    const char *p   = field;
+    const char *end = field + field_size;
+    int star = -1;
+    int gzip = -1, deflate = -1;
+
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char *tok = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t tok_len = (size_t)(p - tok);
+
+        int accept = 1;
+        while (p < end && *p != ',')
+        {
+            if (*p == ';')
+            {
+                p++;
+                while (p < end && (*p == ' ' || *p == '\t')) p++;
+                if (end - p >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=')
+                {
+                    const char *q = p + 2;
+                    p = q;
+                    while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+                    accept = !qvalue_is_zero(q, p);
+                    continue;
+                }
+            }
+            p++;
+        }
+
+        if      (tok_len == 1 && tok[0] == '*')                                   star    = accept;
+        else if ((tok_len == 4 && strncasecmp(tok, "gzip",   4) == 0) ||
+                 (tok_len == 6 && strncasecmp(tok, "x-gzip", 6) == 0))          gzip    = accept;
+        else if (tok_len == 7 && strncasecmp(tok, "deflate", 7) == 0)          deflate = accept;
+    }
+
+    if (gzip    < 0) gzip    = (star > 0);
+    if (deflate < 0) deflate = (star > 0);
+    ae->gzip    |= (uint8_t)gzip;
+    ae->deflate |= (uint8_t)deflate;
+}
 
 http_error_code http_parse_header(http_message_t *message, const char *field, size_t field_size, header_id header_type)
 {
@@ -138,7 +281,7 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
         case HDR_HOST:
             if(message->headers.host != NULL) return Bad_Request;
 
-            message->headers.host = strstrcpy(field, field_size);
+            message->headers.host = msg_strndup(message, field, field_size);
             break;
 
         case HDR_CONNECTION:
@@ -146,15 +289,15 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
             if (message->headers.connection != NULL) return Bad_Request;
 
             /* Header value is case-insensitive — compare on a lowercased copy. */
-            char *lower = strstrcpy(field, field_size);
+            char *lower = msg_strndup(message, field, field_size);
             if (lower == NULL) return Internal_Server_Error;
             lowercase(lower, field_size);
 
-            message->headers.connection = malloc(sizeof(hdr_connection_t));
-            if (message->headers.connection == NULL) { free(lower); return Internal_Server_Error; }
+            message->headers.connection = msg_alloc(message, sizeof(hdr_connection_t));
+            if (message->headers.connection == NULL) { msg_free(message, lower); return Internal_Server_Error; }
             message->headers.connection->keep_alive = (strstr(lower, "keep-alive") != NULL) ? TRUE : FALSE;
             message->headers.connection->upgrade    = (strstr(lower, "upgrade")    != NULL) ? TRUE : FALSE;
-            free(lower);
+            msg_free(message, lower);
             break;
         }
 
@@ -162,19 +305,11 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
         {
             if (message->headers.content_length != NULL) return Bad_Request;
 
-            /* Reject leading sign/whitespace up front so strtoull can't wrap "-1"
-               into a huge size_t. RFC 7230: Content-Length is 1*DIGIT only. */
-            if (field[0] < '0' || field[0] > '9') return Bad_Request;
-
-            char *end = NULL;
-            errno = 0;
-            unsigned long long val = strtoull(field, &end, 10);
-            if (end == field || *end != '\0' || errno == ERANGE)
-                return Bad_Request;
-            if (val > (unsigned long long)SIZE_MAX)
-                return Content_Too_Large;
+            uint64_t val;
+            http_error_code error = http_parse_content_length(field, field_size, &val);
+            if (error != Ok) return error;
 
-            message->headers.content_length = malloc(sizeof(size_t));
+            message->headers.content_length = msg_alloc(message, sizeof(size_t));
             if (message->headers.content_length == NULL)
                 return Internal_Server_Error;
             *(message->headers.content_length) = (size_t)val;
@@ -184,7 +319,49 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
         case HDR_USER_AGENT:
             if (message->headers.user_agent != NULL) return Bad_Request;
 
-            message->headers.user_agent = strstrcpy(field, field_size);
+            message->headers.user_agent = msg_strndup(message, field, field_size);
+            break;
+
+        case HDR_ACCEPT_ENCODING:
+        {
+            /* Repeated lines are one comma-separated list (RFC 9110 5.3). */
+            if (message->headers.accept_enconding == NULL)
+            {
+                message->headers.accept_enconding = msg_alloc(message, sizeof(hdr_accept_enconding_t));
+                if (message->headers.accept_enconding == NULL) return Internal_Server_Error;
+                message->headers.accept_enconding->gzip    = FALSE;
+                message->headers.accept_enconding->deflate = FALSE;
+            }
+            parse_accept_encoding(field, field_size, message->headers.accept_enconding);
+            break;
+        }
+
+        case HDR_RANGE:
+            if (message->headers.range != NULL) return Bad_Request;
+
+            message->headers.range = msg_strndup(message, field, field_size);
+            if (message->headers.range == NULL) return Internal_Server_Error;
+            break;
+
+        case HDR_IF_RANGE:
+            if (message->headers.if_range != NULL) return Bad_Request;
+
+            message->headers.if_range = msg_strndup(message, field, field_size);
+            if (message->headers.if_range == NULL) return Internal_Server_Error;
+            break;
+
+        case HDR_IF_NONE_MATCH:
+            if (message->headers.if_none_match != NULL) return Bad_Request;
+
+            message->headers.if_none_match = msg_strndup(message, field, field_size);
+            if (message->headers.if_none_match == NULL) return Internal_Server_Error;
+            break;
+
+        case HDR_IF_MODIFIED_SINCE:
+            if (message->headers.if_modified_since != NULL) return Bad_Request;
+
+            message->headers.if_modified_since = msg_strndup(message, field, field_size);
+            if (message->headers.if_modified_since == NULL) return Internal_Server_Error;
             break;
 
         case HDR_CONTENT_TYPE:
@@ -193,7 +370,7 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
 
             /* Isolate the media-type token: everything up to ';' or whitespace. */
             size_t type_len = 0;
-            while (field[type_len] != '\0' &&
+            while (type_len < field_size &&
                    field[type_len] != ';'  &&
                    field[type_len] != ' '  &&
                    field[type_len] != '\t')
@@ -205,7 +382,7 @@ http_error_code http_parse_header(http_message_t *message, const char *field, si
                 if (strlen(MimeType[i]) != type_len) continue;
                 if (strncmp(field, MimeType[i], type_len) != 0) continue;
 
-                message->headers.content_type = malloc(sizeof(hdr_content_type_t));
+                message->headers.content_type = msg_alloc(message, sizeof(hdr_content_type_t));
                 if (message->headers.content_type == NULL) return Internal_Server_Error;
                 message->headers.content_type->content_type = (content_type_t)i;
                 message->headers.content_type->charset      = NULL;
@@ -227,187 +404,118 @@ http_error_code http_parse_message(const char *message, size_t message_size, htt
     if (message == NULL || parsed_message == NULL)
         return Internal_Server_Error;
 
+    arena_t *arena = parsed_message->arena;
     memset(parsed_message, 0, sizeof(*parsed_message));
+    parsed_message->arena = arena;
 
-    http_error_code http_error = Ok;
-
-    /* Parse the request line: METHOD SP /TARGET SP HTTP/D.D CRLF */
+    http_request_t *req = msg_alloc(parsed_message, sizeof(http_request_t));
+    if (req == NULL) return Internal_Server_Error;
+    parsed_message->request = req;
 
-    const char *p   = message;
-    const char *end = message + message_size;
-
-    /* Method: one or more uppercase ASCII letters */
-    const char *method_start = p;
-    while (p < end && *p >= 'A' && *p <= 'Z') p++;
-    if (p == method_start || p >= end || *p != ' ')
+    http_error_code http_error = http_request_parse(message, message_size, req);
+    if (http_error != Ok && http_error != No_Content)
     {
-        log_write(LOG_DEBUG, "Bad Request Line (method)\n");
-        return Bad_Request;
+        http_message_free(parsed_message);
+        return http_error;
     }
-    size_t method_len = (size_t)(p - method_start);
-    p++; /* skip SP */
 
-    /* Target: leading '/', then any non-space up to next SP */
-    if (p >= end || *p != '/')
-    {
-        log_write(LOG_DEBUG, "Bad Request Line (target)\n");
-        return Bad_Request;
-    }
-    p++; /* skip leading '/' (not included in captured target) */
-    const char *target_start = p;
-    while (p < end && *p != ' ' && *p != '\r') p++;
-    if (p >= end || *p != ' ')
-    {
-        log_write(LOG_DEBUG, "Bad Request Line (target terminator)\n");
-        return Bad_Request;
-    }
-    size_t target_len = (size_t)(p - target_start);
-    p++; /* skip SP */
+    http_error_code error = http_message_from_request(parsed_message, message, req);
+    return (error != Ok) ? error : http_error;
+}
 
-    /* Version: literal "HTTP/" D "." D CRLF */
-    if ((size_t)(end - p) < 8 || memcmp(p, "HTTP/", 5) != 0)
-    {
-        log_write(LOG_DEBUG, "Bad Request Line (version prefix)\n");
-        return Bad_Request;
-    }
-    p += 5;
-    if (p[0] < '0' || p[0] > '9' || p[1] != '.' || p[2] < '0' || p[2] > '9')
-    {
-        log_write(LOG_DEBUG, "Bad Request Line (version digits)\n");
-        return Bad_Request;
-    }
-    uint8_t major = (uint8_t)(p[0] - '0');
-    uint8_t minor = (uint8_t)(p[2] - '0');
-    p += 3;
-    if ((size_t)(end - p) < 2 || p[0] != '\r' || p[1] != '\n')
-    {
-        log_write(LOG_DEBUG, "Bad Request Line (CRLF)\n");
-        return Bad_Request;
-    }
-    p += 2;
+http_error_code http_message_from_request(http_message_t *parsed_message, const char *message,
+                                          const http_request_t *req)
+{
+    /* All the syntax work happened in the zero-copy parser; this only
+       materialises the fields older code reads as strings. */
+    parsed_message->request = req;
+    parsed_message->raw     = message;
 
-    parsed_message->request_line.method              = strstrcpy(method_start, method_len);
-    parsed_message->request_line.target_resource    = strstrcpy(target_start, target_len);
-    parsed_message->request_line.http_major_version = major;
-    parsed_message->request_line.http_minor_version = minor;
+    http_error_code http_error = Ok;
 
-    /* Resolve the method to an enum index once — validate/action both use it. */
-    parsed_message->request_line.method_code = METHOD_COUNT;
-    for (uint8_t j = 0; j < METHOD_COUNT; j++)
+    parsed_message->request_line.method             = msg_strndup(parsed_message, message + req->method.off, req->method.len);
+    parsed_message->request_line.target_resource    = msg_strndup(parsed_message, message + req->target.off, req->target.len);
+    parsed_message->request_line.http_major_version = req->http_major_version;
+    parsed_message->request_line.http_minor_version = req->http_minor_version;
+    parsed_message->request_line.method_code        = req->method_code;
+    if (parsed_message->request_line.method == NULL || parsed_message->request_line.target_resource == NULL)
     {
-        if (strlen(http_methods_name[j]) == method_len &&
-            memcmp(method_start, http_methods_name[j], method_len) == 0)
-        {
-            parsed_message->request_line.method_code = j;
-            break;
-        }
+        http_error = Internal_Server_Error;
+        goto cleanup;
     }
 
-    /* Strip query string */
-    char *qs = strchr(parsed_message->request_line.target_resource, '?');
-    if (qs != NULL) *qs = '\0';
-
     /* Treat bare "/" as "home" so the default page is home.html */
     if (parsed_message->request_line.target_resource[0] == '\0')
     {
-        free(parsed_message->request_line.target_resource);
-        parsed_message->request_line.target_resource = strstrcpy("home", 4);
+        msg_free(parsed_message, parsed_message->request_line.target_resource);
+        parsed_message->request_line.target_resource = msg_strndup(parsed_message, "home", 4);
     }
     log_write(LOG_DEBUG, "Target Resource: %s\n", parsed_message->request_line.target_resource);
 
-    /* Get and parse headers */
-
-    int header_length = 0, subString_length = 0;
-    const char *init_pos = p, *end_pos = NULL, delimiter = ':', *delimiter_pos = NULL;
-    char header[256];
-
-    while (1)
+    for (uint16_t i = 0; i < req->header_count; i++)
     {
-        end_pos = strstr(init_pos, "\r\n");
-
-        if(end_pos == NULL)
-        {
-            log_write(LOG_DEBUG, "Didn't find CRLF at the end of line\n");
-            http_error = Bad_Request;
-            goto cleanup;
-
-        }else if(end_pos-init_pos < 1)
-        {
-            break;
-        }
-
-        header_length = end_pos-init_pos;
-        if ((size_t)header_length >= sizeof(header))
-        {
-            log_write(LOG_DEBUG, "Header length higher than the size supported\n");
-            http_error = Bad_Request;
-            goto cleanup;
-        }
-        memcpy(header, init_pos, header_length);
-        header[header_length] = '\0';
-
-        delimiter_pos = strchr(header, delimiter);
+        const http_header_t *hdr = &req->headers[i];
+        if (hdr->id == HDR_UNKNOWN) continue;
 
-        if (delimiter_pos == NULL)
+        http_error_code error = http_parse_header(parsed_message, message + hdr->value.off,
+                                                  hdr->value.len, (header_id)hdr->id);
+        if (error != Ok)
         {
-            log_write(LOG_DEBUG, "Didn't find %c in %s\n", delimiter, header);
-            http_error = Bad_Request;
+            http_error = error;
             goto cleanup;
         }
+    }
 
-        subString_length = delimiter_pos - header;
-        header[subString_length] = '\0';
-        lowercase(header, subString_length);
-
-        const char *value_pos = delimiter_pos + 1;
-        int value_len = header_length - subString_length - 1;
-        while (value_len > 0 && *value_pos == ' ') { value_pos++; value_len--; }
-
-        if (strchr(header, ' ') != NULL)
+    /* The body is borrowed from the connection buffer, which outlives the
+       request just like the arena; only heap-mode callers get a copy. A
+       partial body is the start of an upload still arriving on the socket.
+       A chunked one is decoded into request memory, which the payload
+       never outgrows, and the decoder is kept for the rest. */
+    if (req->chunked)
+    {
+        parsed_message->chunked = msg_alloc(parsed_message, sizeof(http_chunked_t));
+        char *content           = msg_alloc(parsed_message, (size_t)req->body.len + 1);
+        if (parsed_message->chunked == NULL || content == NULL)
         {
-            http_error = Bad_Request;
+            msg_free(parsed_message, content);
+            http_error = Internal_Server_Error;
             goto cleanup;
         }
 
-        for (int i=0; i<HDR_UNKNOWN; i++)
-        {
-            if (strcmp(header, known_headers[i]) == 0)
-            {
-                http_parse_header(parsed_message, value_pos, value_len, i);
-                break;
-            }
-        }
-
-        init_pos = end_pos+2;
+        size_t used, produced;
+        http_chunked_init(parsed_message->chunked);
+        http_chunked_decode(parsed_message->chunked, message + req->body.off, req->body.len,
+                            content, &used, &produced);
+        parsed_message->content          = content;
+        parsed_message->content_received = produced;
+        return Ok;
     }
 
-    if (parsed_message->headers.content_length != NULL &&
-        *(parsed_message->headers.content_length) > 0)
+    if (req->body.len > 0)
     {
-        const char *body_start = end_pos + 2;
-        size_t body_present    = (size_t)((message + message_size) - body_start);
-        size_t content_len     = *(parsed_message->headers.content_length);
-
-        if (body_present >= content_len)
-        {
-            parsed_message->content = strstrcpy(body_start, content_len);
-        }
-        else
-        {
-            /* Full body not here yet — caller must recv() the remaining bytes
-               into the buffer (continuing at message + message_size). */
-            http_error = No_Content;
-        }
+        parsed_message->content = (parsed_message->arena != NULL)
+                                  ? message + req->body.off
+                                  : msg_strndup(parsed_message, message + req->body.off, req->body.len);
+        if (parsed_message->content == NULL) http_error = Internal_Server_Error;
     }
+    parsed_message->content_received = req->body.len;
 
 cleanup:
-    /* Release partial allocations on any error path except No_Content
-       (No_Content means the caller will finish the read and retry). */
-    if (http_error != Ok && http_error != No_Content)
+    if (http_error != Ok)
         http_message_free(parsed_message);
     return http_error;
 }
 
+int http_body_complete(const http_message_t *parsed_message)
+{
+    if (parsed_message->chunked != NULL)
+        return http_chunked_done(parsed_message->chunked);
+
+    uint64_t content_length = (parsed_message->headers.content_length != NULL)
+                              ? *parsed_message->headers.content_length : 0;
+    return parsed_message->content_received == content_length;
+}
+
 http_error_code http_validate_message(http_message_t *parsed_message)
 {
     /*** Validate Request Line ***/
@@ -425,62 +533,33 @@ http_error_code http_validate_message(http_message_t *parsed_message)
                          : 0;
 
     http_error_code error = Not_Found;
+    const char *target = parsed_message->request_line.target_resource;
 
-    /* Pass 1: exact name match (non-directory resources) */
-    for (int i = 0; i < (int)g_resource_count && error == Not_Found; i++)
+    /* Exact name match (non-directory resources) */
+    int32_t id = route_find_exact(g_routes, target);
+    if (id >= 0)
     {
-        if (g_resources[i].is_directory) continue;
-        if (strcmp(parsed_message->request_line.target_resource, g_resources[i].name) != 0) continue;
-
-        parsed_message->resource_id = i;
-
-        if (parsed_message->request_line.method_code == POST)
-        {
-            if (parsed_message->headers.content_type != NULL &&
-                parsed_message->headers.content_type->content_type != g_resources[i].extension)
-            {
-                error = Not_Found;
-                break;
-            }
-        }
-
-        error = (method_bit && (g_resources[i].allowed_methods & method_bit))
+        error = (method_bit && (g_resources[id].allowed_methods & method_bit))
                 ? Ok : Method_Not_Allowed;
+
+        if (parsed_message->request_line.method_code == POST &&
+            parsed_message->headers.content_type != NULL &&
+            parsed_message->headers.content_type->content_type != g_resources[id].extension)
+            error = Not_Found;
     }
 
-    /* Pass 2: directory prefix match */
+    /* Longest directory prefix match */
     if (error == Not_Found)
     {
-        const char *target = parsed_message->request_line.target_resource;
-
-        for (int i = 0; i < (int)g_resource_count; i++)
-        {
-            if (!g_resources[i].is_directory) continue;
-
-            int match;
-            if (strcmp(g_resources[i].name, ".") == 0)
-            {
-                /* "." means root — matches every path */
-                match = 1;
-            }
-            else
-            {
-                size_t name_len = strlen(g_resources[i].name);
-                /* Prefix must end at a component boundary: end-of-string or '/'. */
-                match = (strncmp(target, g_resources[i].name, name_len) == 0) &&
-                        (target[name_len] == '\0' || target[name_len] == '/');
-            }
-            if (!match) continue;
-
-            parsed_message->resource_id = i;
-            error = (method_bit && (g_resources[i].allowed_methods & method_bit))
+        id = route_find_prefix(g_routes, target);
+        if (id >= 0)
+            error = (method_bit && (g_resources[id].allowed_methods & method_bit))
                     ? Ok : Method_Not_Allowed;
-            break;
-        }
     }
 
     if (error != Ok)
         return error;
+    parsed_message->resource_id = id;
     
     /*** Validate Headers Fields ***/
 
@@ -489,22 +568,565 @@ http_error_code http_validate_message(http_message_t *parsed_message)
     if (parsed_message->headers.host == NULL)
         return Bad_Request;
 
+    /* Only POST takes a body it cannot see whole: it streams it to disk.
+       Anything else arriving with a large body is refused. A chunked body
+       has no size up front; one still arriving is held to max_body as it
+       is written (see write_body()). */
+    int      chunked  = (parsed_message->chunked != NULL);
+    int      complete = http_body_complete(parsed_message);
+    uint64_t content_length = chunked ? parsed_message->content_received
+                            : (parsed_message->headers.content_length != NULL)
+                              ? *parsed_message->headers.content_length : 0;
+    if (parsed_message->request_line.method_code == POST
+        ? content_length > g_resources[parsed_message->resource_id].max_body
+        : !complete)
+        return Content_Too_Large;
+
     /* Reject body-less POST if resource requires one */
     if (g_resources[parsed_message->resource_id].require_body &&
         parsed_message->request_line.method_code == POST &&
-        (parsed_message->headers.content_length == NULL ||
-         *(parsed_message->headers.content_length) == 0))
+        content_length == 0 && (complete || !chunked))
         return Bad_Request;
 
     return Ok;
 }
 
-/* Stream a GET response directly to the client via send() + sendfile().
-   Returns 1 on success, 0 on any failure (caller falls back to 500). */
+#define FILE_HEAD_SIZE 512
+#define META_SIZE      320
+#define ETAG_SIZE      72
+#define GZIP_KEY_SIZE  80
+
+static file_ident_t ident_from_stat(const struct stat *st)
+{
+    file_ident_t ident = {
+        .dev      = (uint64_t)st->st_dev,
+        .ino      = (uint64_t)st->st_ino,
+        .size     = (uint64_t)st->st_size,
+        .mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec
+    };
+    return ident;
+}
+
+/* Compressed bodies are cached under the identity of the file they came
+   from rather than its path, so a rewritten file simply stops matching. */
+static void gzip_key(char *key, const file_ident_t *ident)
+{
+    snprintf(key, GZIP_KEY_SIZE, "%llx:%llx:%llx:%llx",
+             (unsigned long long)ident->dev, (unsigned long long)ident->ino,
+             (unsigned long long)ident->size, (unsigned long long)ident->mtime_ns);
+}
+
+/* Strong entity tag of one version of a file, quotes included. Each
+   encoding is a different representation, so gzip gets its own tag. */
+static void format_etag(char *tag, const file_ident_t *ident, int gzipped)
+{
+    snprintf(tag, ETAG_SIZE, "\"%llx-%llx-%llx%s\"",
+             (unsigned long long)ident->ino, (unsigned long long)ident->size,
+             (unsigned long long)ident->mtime_ns, gzipped ? "-gz" : "");
+}
+
+/* Validators and caching headers of one version of a file, repeated by
+   every 200, 206 and 304 about it. Compressible types carry Vary whichever
+   encoding went out, so shared caches keep both. */
+static int format_meta(char *meta, const resource_t *res, content_type_t mime,
+                       const file_ident_t *ident, int gzipped)
+{
+    char etag[ETAG_SIZE];
+    char date[40];
+    format_etag(etag, ident, gzipped);
+    if (http_date_format(date, sizeof(date), (time_t)(ident->mtime_ns / 1000000000)) != 0) return -1;
+
+    int has_cc = (res->cache_control[0] != '\0');
+    int mlen = snprintf(meta, META_SIZE,
+                        "etag: %s\r\n"
+                        "last-Modified: %s\r\n"
+                        "%s%s%s"
+                        "%s",
+                        etag, date,
+                        has_cc ? "cache-Control: " : "", res->cache_control, has_cc ? "\r\n" : "",
+                        gzip_compressible(mime) ? "vary: Accept-Encoding\r\n" : "");
+    return (mlen < 0 || mlen >= META_SIZE) ? -1 : 0;
+}
+
+/* Status line and headers for a 200 with a file body. A negative
+   body_size means the length is not known yet: the body goes chunked. */
+static int format_file_head(char *head, content_type_t mime, off_t body_size, int gzipped,
+                            const char *meta, int keep_alive)
+{
+    char length[48];
+    if (body_size < 0) snprintf(length, sizeof(length), "transfer-Encoding: chunked\r\n");
+    else               snprintf(length, sizeof(length), "content-Length: %lld\r\n", (long long)body_size);
+
+    int hlen = snprintf(head, FILE_HEAD_SIZE,
+                        "HTTP/1.1 200 Ok\r\n"
+                        "content-Type: %s\r\n"
+                        "%s"
+                        "%s"
+                        "%s"
+                        "%s"
+                        "connection: %s\r\n"
+                        "\r\n",
+                        MimeType[mime],
+                        gzipped ? "content-Encoding: gzip\r\n" : "",
+                        length,
+                        gzipped ? "" : "accept-Ranges: bytes\r\n",
+                        meta,
+                        keep_alive ? "keep-alive" : "close");
+    return (hlen < 0 || hlen >= FILE_HEAD_SIZE) ? -1 : hlen;
+}
+
+/* Both heads, indexed by keep-alive as in file_cache_entry_t. */
+static int format_file_heads(char head[2][FILE_HEAD_SIZE], int hlen[2], const resource_t *res,
+                             content_type_t mime, const file_ident_t *ident, off_t body_size, int gzipped)
+{
+    char meta[META_SIZE];
+    if (format_meta(meta, res, mime, ident, gzipped) != 0) return -1;
+
+    for (int k = 0; k < 2; k++)
+    {
+        hlen[k] = format_file_head(head[k], mime, body_size, gzipped, meta, k);
+        if (hlen[k] < 0) return -1;
+    }
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*             Conditional requests             */
+/*----------------------------------------------*/
+
+/* Whether an If-None-Match list names this version of the file. The
+   header calls for weak comparison, so W/ is ignored; either encoding's
+   tag matches, the client's copy being current in both cases. */
+static int etag_list_matches(const char *list, const file_ident_t *ident)
+{
+    char tag[2][ETAG_SIZE];
+    format_etag(tag[0], ident, 0);
+    format_etag(tag[1], ident, 1);
+
+    const char *p = list;
+    for (;;)
+    {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (*p == '\0') return 0;
+        if (*p == '*') return 1;
+
+        if (strncmp(p, "W/", 2) == 0) p += 2;
+        if (*p != '"') return 0;
+        const char *close = strchr(p + 1, '"');
+        if (close == NULL) return 0;
+
+        size_t len = (size_t)(close - p) + 1;
+        for (int k = 0; k < 2; k++)
+            if (len == strlen(tag[k]) && memcmp(p, tag[k], len) == 0) return 1;
+        p = close + 1;
+    }
+}
+
+/* RFC 9110 13.2.2: If-None-Match, when present, decides alone;
+   If-Modified-Since holds while the file is no newer than its date. */
+static int not_modified(const http_message_t *message, const file_ident_t *ident)
+{
+    if (message->headers.if_none_match != NULL)
+        return etag_list_matches(message->headers.if_none_match, ident);
+
+    const char *since = message->headers.if_modified_since;
+    time_t t;
+    if (since != NULL && http_date_parse(since, strlen(since), &t) == 0)
+        return ident->mtime_ns / 1000000000 <= (int64_t)t;
+    return 0;
+}
+
+/* 304 with the validators the 200 would have carried, and no body. */
+static int send_not_modified(int client_fd, const resource_t *res, content_type_t mime,
+                             const file_ident_t *ident, int gzipped, int keep_alive)
+{
+    char meta[META_SIZE];
+    if (format_meta(meta, res, mime, ident, gzipped) != 0) return -1;
+
+    char head[FILE_HEAD_SIZE];
+    int hlen = snprintf(head, sizeof(head),
+                        "HTTP/1.1 %d %s\r\n"
+                        "%s"
+                        "connection: %s\r\n"
+                        "\r\n",
+                        Not_Modified, get_http_error_name(Not_Modified),
+                        meta,
+                        keep_alive ? "keep-alive" : "close");
+    if (hlen < 0 || hlen >= (int)sizeof(head)) return -1;
+    return send_all(client_fd, head, (size_t)hlen);
+}
+
+static int send_cached(int client_fd, const file_cache_entry_t *entry, int keep_alive)
+{
+    struct iovec iov[2] = {
+        { (void *)entry->head[keep_alive], entry->head_len[keep_alive] },
+        { (void *)entry->body,             entry->body_len }
+    };
+    return sendv_all(client_fd, iov, 2);
+}
+
+/* Headers, then `size` bytes of the file from `offset` via sendfile (or a
+   linked send + splice chain on io_uring) — no userspace copy. Returns 0
+   on success. */
+static int send_file_body(int client_fd, const char *head, size_t head_len, int file_fd,
+                          off_t offset, size_t size)
+{
+    if (g_io_backend == IO_BACKEND_URING)
+        return uring_send_file(client_fd, head, head_len, file_fd, offset, size) ? -1 : 0;
+
+    return (send_all(client_fd, head, head_len) != 0 ||
+            sendfile_all(client_fd, file_fd, offset, size) != 0) ? -1 : 0;
+}
+
+/*----------------------------------------------*/
+/*                Byte ranges                   */
+/*----------------------------------------------*/
+
+#define PART_HEAD_SIZE 192
+
+/* If-Range carries a validator from an earlier response: an entity tag,
+   compared strongly with the identity tag (ranges never use gzip), or a
+   date, which must equal the file's modification time to the second. */
+static int if_range_matches(const char *value, const file_ident_t *ident)
+{
+    if (strncmp(value, "W/", 2) == 0) return 0;
+    if (value[0] == '"')
+    {
+        char tag[ETAG_SIZE];
+        format_etag(tag, ident, 0);
+        return strcmp(value, tag) == 0;
+    }
+
+    time_t t;
+    if (http_date_parse(value, strlen(value), &t) != 0) return 0;
+    return (int64_t)t == ident->mtime_ns / 1000000000;
+}
+
+/* Ranges to answer with: -1 for the whole file (no usable Range, or an
+   If-Range that no longer matches), 0 for a 416, otherwise their count. */
+static int select_ranges(const http_message_t *message, const file_ident_t *ident,
+                         byte_range_t ranges[RANGE_MAX])
+{
+    const char *range = message->headers.range;
+    if (range == NULL) return -1;
+    if (message->headers.if_range != NULL && !if_range_matches(message->headers.if_range, ident)) return -1;
+
+    return range_parse(range, strlen(range), ident->size, ranges);
+}
+
+/* 416 naming the current length, so the client can retry sensibly. */
+static int send_unsatisfiable(int client_fd, uint64_t size, int keep_alive)
+{
+    char head[FILE_HEAD_SIZE];
+    int hlen = snprintf(head, sizeof(head),
+                        "HTTP/1.1 %d %s\r\n"
+                        "content-Range: bytes */%llu\r\n"
+                        "content-Length: 0\r\n"
+                        "connection: %s\r\n"
+                        "\r\n",
+                        Range_Not_Satisfiable, get_http_error_name(Range_Not_Satisfiable),
+                        (unsigned long long)size,
+                        keep_alive ? "keep-alive" : "close");
+    if (hlen < 0 || hlen >= (int)sizeof(head)) return -1;
+    return send_all(client_fd, head, (size_t)hlen);
+}
+
+/* A 206 for `n` ranges of a file, from its cached body `body` or else from
+   file_fd. One range is the plain body slice; several become a
+   multipart/byteranges body whose part headers are gathered with the data
+   (cached) or written between sendfile() calls. Returns 0 on success. */
+static int send_ranges(int client_fd, const resource_t *res, content_type_t mime, const file_ident_t *ident,
+                       const byte_range_t *ranges, int n, const char *body, int file_fd, int keep_alive)
+{
+    static uint32_t boundary_seq;
+
+    if (n == 0) return send_unsatisfiable(client_fd, ident->size, keep_alive);
+
+    char     type[96];
+    char     content_range[96] = "";
+    char     boundary[40];
+    char     parts[RANGE_MAX][PART_HEAD_SIZE];
+    int      part_len[RANGE_MAX];
+    char     trailer[64];
+    int      trailer_len = 0;
+    uint64_t length      = 0;
+
+    if (n == 1)
+    {
+        snprintf(type, sizeof(type), "%s", MimeType[mime]);
+        snprintf(content_range, sizeof(content_range), "content-Range: bytes %llu-%llu/%llu\r\n",
+                 (unsigned long long)ranges[0].first, (unsigned long long)ranges[0].last,
+                 (unsigned long long)ident->size);
+        length = ranges[0].last - ranges[0].first + 1;
+    }
+    else
+    {
+        /* Unique per response; the body is a file that could contain any
+           fixed string. */
+        snprintf(boundary, sizeof(boundary), "%016llx%08x",
+                 (unsigned long long)(ident->ino ^ (uint64_t)ident->mtime_ns),
+                 __atomic_add_fetch(&boundary_seq, 1, __ATOMIC_RELAXED));
+        snprintf(type, sizeof(type), "multipart/byteranges; boundary=%s", boundary);
+
+        for (int i = 0; i < n; i++)
+        {
+            part_len[i] = snprintf(parts[i], PART_HEAD_SIZE,
+                                   "\r\n--%s\r\n"
+                                   "content-Type: %s\r\n"
+                                   "content-Range: bytes %llu-%llu/%llu\r\n"
+                                   "\r\n",
+                                   boundary, MimeType[mime],
+                                   (unsigned long long)ranges[i].first, (unsigned long long)ranges[i].last,
+                                   (unsigned long long)ident->size);
+            if (part_len[i] < 0 || part_len[i] >= PART_HEAD_SIZE) return -1;
+            length += (uint64_t)part_len[i] + (ranges[i].last - ranges[i].first + 1);
+        }
+        trailer_len = snprintf(trailer, sizeof(trailer), "\r\n--%s--\r\n", boundary);
+        length += (uint64_t)trailer_len;
+    }
+
+    char meta[META_SIZE];
+    if (format_meta(meta, res, mime, ident, 0) != 0) return -1;
+
+    char head[FILE_HEAD_SIZE];
+    int hlen = snprintf(head, sizeof(head),
+                        "HTTP/1.1 %d %s\r\n"
+                        "content-Type: %s\r\n"
+                        "%s"
+                        "content-Length: %llu\r\n"
+                        "accept-Ranges: bytes\r\n"
+                        "%s"
+                        "connection: %s\r\n"
+                        "\r\n",
+                        Partial_Content, get_http_error_name(Partial_Content),
+                        type, content_range, (unsigned long long)length,
+                        meta,
+                        keep_alive ? "keep-alive" : "close");
+    if (hlen < 0 || hlen >= (int)sizeof(head)) return -1;
+
+    if (n == 1)
+    {
+        size_t len = (size_t)(ranges[0].last - ranges[0].first + 1);
+        if (body == NULL)
+            return send_file_body(client_fd, head, (size_t)hlen, file_fd, (off_t)ranges[0].first, len);
+
+        struct iovec iov[2] = {
+            { head,                                    (size_t)hlen },
+            { (void *)(body + ranges[0].first),        len }
+        };
+        return sendv_all(client_fd, iov, 2);
+    }
+
+    if (body != NULL)
+    {
+        struct iovec iov[2 + 2 * RANGE_MAX];
+        int k = 0;
+        iov[k++] = (struct iovec){ head, (size_t)hlen };
+        for (int i = 0; i < n; i++)
+        {
+            iov[k++] = (struct iovec){ parts[i], (size_t)part_len[i] };
+            iov[k++] = (struct iovec){ (void *)(body + ranges[i].first),
+                                       (size_t)(ranges[i].last - ranges[i].first + 1) };
+        }
+        iov[k++] = (struct iovec){ trailer, (size_t)trailer_len };
+        return sendv_all(client_fd, iov, k);
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        struct iovec iov[2];
+        int k = 0;
+        if (i == 0) iov[k++] = (struct iovec){ head, (size_t)hlen };
+        iov[k++] = (struct iovec){ parts[i], (size_t)part_len[i] };
+
+        if (sendv_all(client_fd, iov, k) != 0 ||
+            sendfile_all(client_fd, file_fd, (off_t)ranges[i].first,
+                         (size_t)(ranges[i].last - ranges[i].first + 1)) != 0)
+            return -1;
+    }
+    return send_all(client_fd, trailer, (size_t)trailer_len);
+}
+
+/* Compress the file described by `ident` from `src` (the cached plain
+   body) or else from `file_fd`, and cache the result. Only done when the
+   result is sure to fit the gzip cache, so each version is compressed
+   once. A body that does not shrink is cached as an empty entry, telling
+   later requests to send identity without trying again. */
+static file_cache_entry_t *gzip_file(const char *key, const resource_t *res, content_type_t mime,
+                                     const file_ident_t *ident, const char *src, int file_fd)
+{
+    size_t size = (size_t)ident->size;
+    if (g_gzip_level <= 0 || !file_cache_accepts(&g_gzip_cache, size)) return NULL;
+
+    char *copy = NULL;
+    if (src == NULL)
+    {
+        copy = malloc(size ? size : 1);
+        if (copy == NULL) return NULL;
+        if (pread_all(file_fd, copy, size, 0) != 0) { free(copy); return NULL; }
+        src = copy;
+    }
+
+    char  *out;
+    size_t out_len;
+    int rc = gzip_compress(src, size, g_gzip_level, &out, &out_len);
+    free(copy);
+    if (rc != 0) return NULL;
+
+    char head[2][FILE_HEAD_SIZE];
+    int  hlen[2];
+    file_cache_entry_t *gz;
+    if (out_len >= size || format_file_heads(head, hlen, res, mime, ident, (off_t)out_len, 1) != 0)
+        gz = file_cache_insert_mem(&g_gzip_cache, key, ident, "", 0, "", 0, "", 0);
+    else
+        gz = file_cache_insert_mem(&g_gzip_cache, key, ident, out, out_len,
+                                   head[0], (size_t)hlen[0], head[1], (size_t)hlen[1]);
+    free(out);
+    return gz;
+}
+
+/* One chunk of a body sent as it is produced; ctx is the client socket.
+   The empty last-chunk that ends the body has the same shape. */
+static int send_chunk(void *ctx, const char *data, size_t length)
+{
+    char size_line[24];
+    int  slen = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+    struct iovec iov[3] = {
+        { size_line,      (size_t)slen },
+        { (void *)data,   length },
+        { (void *)"\r\n", 2 }
+    };
+    return sendv_all(*(int *)ctx, iov, 3);
+}
+
+/* A file too big for the gzip cache, compressed while it is sent: the
+   length is unknown until the end, so the body is chunked. Memory use is
+   two fixed buffers and the first bytes leave before the file is read. */
+static int send_gzip_chunked(int client_fd, const resource_t *res, content_type_t mime,
+                             const file_ident_t *ident, int file_fd, int keep_alive)
+{
+    char meta[META_SIZE];
+    char head[FILE_HEAD_SIZE];
+    if (format_meta(meta, res, mime, ident, 1) != 0) return 0;
+    int hlen = format_file_head(head, mime, -1, 1, meta, keep_alive);
+    if (hlen < 0 || send_all(client_fd, head, (size_t)hlen) != 0) return 0;
+
+    return gzip_compress_file(file_fd, ident->size, g_gzip_level, send_chunk, &client_fd) == 0 &&
+           send_chunk(&client_fd, "", 0) == 0;
+}
+
+/* Send the gzip encoding of `path`: from the gzip cache, from a sidecar
+   "<path>.gz" no older than the file, or compressed here (gzip_file(), or
+   send_gzip_chunked() when `may_stream` and the file is too big to cache).
+   Returns 1 on success, 0 on a send failure, -1 to send identity instead. */
+static int send_gzip(int client_fd, const resource_t *res, const char *path, content_type_t mime,
+                     const file_ident_t *ident, const char *src, int file_fd, int may_stream, int keep_alive)
+{
+    char key[GZIP_KEY_SIZE];
+    gzip_key(key, ident);
+
+    file_cache_entry_t *gz = file_cache_get(&g_gzip_cache, key);
+    if (gz == NULL)
+    {
+        char gz_path[PATH_MAX];
+        int  gz_fd = -1;
+        if (snprintf(gz_path, sizeof(gz_path), "%s.gz", path) < (int)sizeof(gz_path))
+            gz_fd = open(gz_path, O_RDONLY);
+
+        if (gz_fd >= 0)
+        {
+            char head[2][FILE_HEAD_SIZE];
+            int  hlen[2];
+            struct stat st;
+
+            if (fstat(gz_fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                ident_from_stat(&st).mtime_ns >= ident->mtime_ns &&
+                format_file_heads(head, hlen, res, mime, ident, st.st_size, 1) == 0)
+            {
+                gz = file_cache_insert(&g_gzip_cache, key, ident, gz_fd, (size_t)st.st_size,
+                                       head[0], (size_t)hlen[0], head[1], (size_t)hlen[1]);
+                if (gz == NULL)
+                {
+                    int ok = (send_file_body(client_fd, head[keep_alive], (size_t)hlen[keep_alive],
+                                             gz_fd, 0, (size_t)st.st_size) == 0);
+                    close(gz_fd);
+                    return ok;
+                }
+            }
+            close(gz_fd);
+        }
+
+        if (gz == NULL) gz = gzip_file(key, res, mime, ident, src, file_fd);
+        if (gz == NULL && may_stream && src == NULL && g_gzip_level > 0 &&
+            !file_cache_accepts(&g_gzip_cache, (size_t)ident->size) && ident->size <= g_gzip_stream_max)
+            return send_gzip_chunked(client_fd, res, mime, ident, file_fd, keep_alive);
+        if (gz == NULL) return -1;
+    }
+
+    int ok = (gz->head_len[keep_alive] == 0) ? -1 : (send_cached(client_fd, gz, keep_alive) == 0);
+    file_cache_release(gz);
+    return ok;
+}
+
+/* Answer from a plain cache entry: a 304, a range, the gzip copy, or the
+   whole body. Needs no filesystem calls beyond what a gzip miss costs. */
+static int send_from_entry(int client_fd, const http_message_t *message, const resource_t *res,
+                           const char *path, content_type_t mime,
+                           const file_cache_entry_t *entry, int want_gzip, int keep_alive)
+{
+    if (not_modified(message, &entry->ident))
+        return send_not_modified(client_fd, res, mime, &entry->ident, want_gzip, keep_alive) == 0;
+
+    byte_range_t ranges[RANGE_MAX];
+    int n = select_ranges(message, &entry->ident, ranges);
+    if (n >= 0)
+        return send_ranges(client_fd, res, mime, &entry->ident, ranges, n, entry->body, -1, keep_alive) == 0;
+
+    int ok = want_gzip ? send_gzip(client_fd, res, path, mime, &entry->ident, entry->body, -1, 0, keep_alive) : -1;
+    return (ok >= 0) ? ok : (send_cached(client_fd, entry, keep_alive) == 0);
+}
+
+/* The metrics resource: rendered afresh on each scrape, never cached. */
+static int send_metrics(int client_fd, int keep_alive)
+{
+    size_t body_len;
+    char  *body = metrics_render(&body_len);
+    if (body == NULL) return -1;
+
+    char head[FILE_HEAD_SIZE];
+    int  hlen = snprintf(head, sizeof(head),
+                         "HTTP/1.1 200 Ok\r\n"
+                         "content-Type: text/plain; version=0.0.4\r\n"
+                         "content-Length: %zu\r\n"
+                         "cache-Control: no-store\r\n"
+                         "connection: %s\r\n"
+                         "\r\n",
+                         body_len, keep_alive ? "keep-alive" : "close");
+
+    if (hlen < 0 || hlen >= (int)sizeof(head))
+    {
+        free(body);
+        return -1;
+    }
+
+    struct iovec iov[2] = { { head, (size_t)hlen }, { body, body_len } };
+    int rc = sendv_all(client_fd, iov, 2);
+    free(body);
+    return rc;
+}
+
+/* Stream a GET response directly to the client. Returns 1 on success, 0 on
+   any failure (caller falls back to 500). */
 static int http_send_get(http_message_t *parsed_message, int client_fd)
 {
     resource_t *res = &g_resources[parsed_message->resource_id];
 
+    if (res->builtin == BUILTIN_METRICS)
+    {
+        hdr_connection_t *conn = parsed_message->headers.connection;
+        return send_metrics(client_fd, conn != NULL && conn->keep_alive) == 0;
+    }
+
     /* Resolve path and MIME type */
     const char *open_path;
     content_type_t mime;
@@ -540,13 +1162,46 @@ static int http_send_get(http_message_t *parsed_message, int client_fd)
 
     log_write(LOG_DEBUG, "Serving: %s  MIME: %s\n", open_path, MimeType[mime]);
 
-    pthread_rwlock_rdlock(&res->rwlock);
+    hdr_connection_t *conn = parsed_message->headers.connection;
+    int keep_alive = (conn != NULL && conn->keep_alive);
+
+    hdr_accept_enconding_t *ae = parsed_message->headers.accept_enconding;
+    int want_gzip = (ae != NULL && ae->gzip && gzip_compressible(mime));
+    /* Ranges address the identity body; a range request never gets gzip. */
+    if (parsed_message->headers.range != NULL) want_gzip = 0;
+
+    /* Hit: one gather-write, no filesystem calls and no resource lock. The
+       reference keeps the bytes alive even if a POST replaces them. The
+       entry's identity finds (or makes) the compressed copy just as cheaply. */
+    file_cache_entry_t *cached = file_cache_get(&g_file_cache, open_path);
+    if (cached != NULL)
+    {
+        int ok = send_from_entry(client_fd, parsed_message, res, open_path, mime, cached, want_gzip, keep_alive);
+        file_cache_release(cached);
+        return ok;
+    }
+
+    /* A revalidation costs one stat(): the file is not even opened. */
+    if (parsed_message->headers.if_none_match != NULL || parsed_message->headers.if_modified_since != NULL)
+    {
+        struct stat st;
+        if (stat(open_path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            file_ident_t ident = ident_from_stat(&st);
+            if (not_modified(parsed_message, &ident))
+                return send_not_modified(client_fd, res, mime, &ident, want_gzip, keep_alive) == 0;
+        }
+    }
+
+    /* No lock: a POST renames a complete new version into place, so the
+       open below gets either the old file or the new one, never a mix.
+       The generation only tells whether a POST committed meanwhile. */
+    uint32_t generation = __atomic_load_n(&res->generation, __ATOMIC_SEQ_CST);
 
-    int file_fd = open(open_path, O_RDONLY);
+    int file_fd = open(open_path, O_RDONLY | O_CLOEXEC);
     if (file_fd < 0)
     {
         log_write(LOG_ERROR, "%s: %s\n", open_path, strerror(errno));
-        pthread_rwlock_unlock(&res->rwlock);
         return 0;
     }
 
@@ -554,52 +1209,136 @@ static int http_send_get(http_message_t *parsed_message, int client_fd)
     if (fstat(file_fd, &st) != 0 || !S_ISREG(st.st_mode))
     {
         close(file_fd);
-        pthread_rwlock_unlock(&res->rwlock);
         return 0;
     }
     off_t file_size = st.st_size;
+    file_ident_t ident = ident_from_stat(&st);
 
-    hdr_connection_t *conn = parsed_message->headers.connection;
-    char head[512];
-    int hlen = snprintf(head, sizeof(head),
-                        "HTTP/1.1 200 Ok\r\n"
-                        "content-Type: %s\r\n"
-                        "content-Length: %lld\r\n"
-                        "connection: %s\r\n"
-                        "\r\n",
-                        MimeType[mime],
-                        (long long)file_size,
-                        (conn != NULL && conn->keep_alive) ? "keep-alive" : "close");
-    if (hlen < 0 || hlen >= (int)sizeof(head))
+    if (want_gzip)
+    {
+        /* HTTP/1.0 has no chunked coding to stream a compressed body in. */
+        int may_stream = (parsed_message->request_line.http_minor_version >= 1);
+        int ok = send_gzip(client_fd, res, open_path, mime, &ident, NULL, file_fd, may_stream, keep_alive);
+        if (ok >= 0)
+        {
+            close(file_fd);
+            return ok;
+        }
+    }
+
+    char head[2][FILE_HEAD_SIZE];
+    int  hlen[2];
+    if (format_file_heads(head, hlen, res, mime, &ident, file_size, 0) != 0)
     {
         close(file_fd);
-        pthread_rwlock_unlock(&res->rwlock);
         return 0;
     }
 
-    /* Send headers */
-    size_t head_sent = 0;
-    while (head_sent < (size_t)hlen)
+    /* Small enough to keep: read it once, publish it and send from memory. */
+    if (file_cache_accepts(&g_file_cache, (size_t)file_size))
     {
-        ssize_t n = send(client_fd, head + head_sent, (size_t)hlen - head_sent, MSG_NOSIGNAL);
-        if (n <= 0) { close(file_fd); pthread_rwlock_unlock(&res->rwlock); return 0; }
-        head_sent += (size_t)n;
+        cached = file_cache_insert(&g_file_cache, open_path, &ident, file_fd, (size_t)file_size,
+                                   head[0], (size_t)hlen[0], head[1], (size_t)hlen[1]);
+        if (cached != NULL)
+        {
+            /* A POST that committed since the open may have invalidated
+               before this insert: drop what might be the old version. */
+            if (__atomic_load_n(&res->generation, __ATOMIC_SEQ_CST) != generation)
+                file_cache_invalidate(&g_file_cache, open_path);
+
+            close(file_fd);
+            int ok = send_from_entry(client_fd, parsed_message, res, open_path, mime, cached, 0, keep_alive);
+            file_cache_release(cached);
+            return ok;
+        }
     }
 
-    /* Stream body via sendfile — no userspace copy. */
-    off_t offset = 0;
-    while (offset < file_size)
+    /* Too big to cache: ranges go straight from the file at their offsets. */
+    byte_range_t ranges[RANGE_MAX];
+    int n = select_ranges(parsed_message, &ident, ranges);
+    int failed = (n >= 0)
+                 ? send_ranges(client_fd, res, mime, &ident, ranges, n, NULL, file_fd, keep_alive)
+                 : send_file_body(client_fd, head[keep_alive], (size_t)hlen[keep_alive], file_fd, 0, (size_t)file_size);
+
+    close(file_fd);
+    return !failed;
+}
+
+static void fsync_parent_dir(const char *path)
+{
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) snprintf(dir, sizeof(dir), ".");
+    else               snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path + (slash == path)), path);
+
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0 || fsync(dir_fd) != 0)
+        log_write(LOG_ERROR, "%s: fsync: %s\n", dir, strerror(errno));
+    if (dir_fd >= 0) close(dir_fd);
+}
+
+#define CHUNKED_BOUNCE (64u << 10)
+
+/* The rest of a chunked body, decoded into file_fd through a fixed buffer.
+   Bytes are peeked, decoded in place, written, and only then consumed up
+   to where the body ended, so a request pipelined behind it stays on the
+   socket. Fails once the payload would pass `limit`. */
+static int recv_chunked(http_message_t *parsed_message, int client_fd, int file_fd, uint64_t limit)
+{
+    char *buf = malloc(CHUNKED_BOUNCE);
+    if (buf == NULL) return -1;
+
+    int rc = -1;
+    for (;;)
     {
-        ssize_t n = sendfile(client_fd, file_fd, &offset, (size_t)(file_size - offset));
-        if (n <= 0) { close(file_fd); pthread_rwlock_unlock(&res->rwlock); return 0; }
+        if (wait_readable(client_fd) != 0) break;
+        ssize_t n = recv(client_fd, buf, CHUNKED_BOUNCE, MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) break;
+
+        size_t used, produced;
+        http_parse_status st = http_chunked_decode(parsed_message->chunked, buf, (size_t)n,
+                                                   buf, &used, &produced);
+        if (st == HTTP_PARSE_ERROR) break;
+        if (parsed_message->content_received + produced > limit)
+        {
+            log_write(LOG_ERROR, "Chunked body over the %llu byte limit\n", (unsigned long long)limit);
+            break;
+        }
+        if (write_all(file_fd, buf, produced) != 0) break;
+        parsed_message->content_received += produced;
+
+        /* MSG_TRUNC drops the peeked bytes without copying them again. */
+        if (recv(client_fd, NULL, used, MSG_TRUNC | MSG_DONTWAIT) != (ssize_t)used) break;
+        if (st == HTTP_PARSE_DONE) { rc = 0; break; }
     }
+    free(buf);
+    return rc;
+}
 
-    close(file_fd);
-    pthread_rwlock_unlock(&res->rwlock);
-    return 1;
+/* The body into file_fd: the part that came in with the head, then the
+   rest straight off the socket (see recv_to_file()), so memory use does
+   not depend on the body size. content_received tracks progress, which
+   tells the caller whether the connection is still in step. */
+static int write_body(http_message_t *parsed_message, int file_fd, int client_fd, uint64_t limit)
+{
+    if (write_all(file_fd, parsed_message->content, (size_t)parsed_message->content_received) != 0)
+        return -1;
+
+    if (parsed_message->chunked != NULL)
+        return http_chunked_done(parsed_message->chunked) ? 0
+             : recv_chunked(parsed_message, client_fd, file_fd, limit);
+
+    uint64_t total = *parsed_message->headers.content_length;
+    if (parsed_message->content_received == total) return 0;
+
+    uint64_t moved = 0;
+    int rc = recv_to_file(client_fd, file_fd, total - parsed_message->content_received, &moved);
+    parsed_message->content_received += moved;
+    return rc;
 }
 
-char *method_action(http_message_t *parsed_message, size_t *body_size)
+char *method_action(http_message_t *parsed_message, int client_fd, size_t *body_size)
 {
     if (parsed_message == NULL || body_size == NULL) return NULL;
 
@@ -610,28 +1349,58 @@ char *method_action(http_message_t *parsed_message, size_t *body_size)
     {
     case POST:
     {
-        pthread_rwlock_wrlock(&res->rwlock);
+        if (parsed_message->headers.content_length == NULL && parsed_message->chunked == NULL) return NULL;
+
+        /* The new version is written beside the target and renamed over it:
+           readers take no lock and always open a complete file, and a
+           failed upload leaves the current one untouched. */
+        char tmp_path[sizeof(res->filename) + 16];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.upload-XXXXXX", res->filename);
+        int file_fd = mkostemp(tmp_path, O_CLOEXEC);
+        if (file_fd < 0)
+        {
+            log_write(LOG_ERROR, "%s: %s\n", tmp_path, strerror(errno));
+            return NULL;
+        }
 
-        FILE *file_fd = fopen(res->filename, "wb");
-        if (file_fd == NULL) { pthread_rwlock_unlock(&res->rwlock); return NULL; }
+        /* Keep the permissions of the version being replaced. */
+        struct stat old_st;
+        fchmod(file_fd, (stat(res->filename, &old_st) == 0) ? (old_st.st_mode & 07777) : 0644);
 
-        if (parsed_message->headers.content_length == NULL) { fclose(file_fd); pthread_rwlock_unlock(&res->rwlock); return NULL; }
-        size_t content_size = *(parsed_message->headers.content_length);
+        int failed = 0;
+        if (write_body(parsed_message, file_fd, client_fd, res->max_body) != 0)
+        {
+            log_write(LOG_ERROR, "%s: upload failed after %llu bytes\n", res->filename,
+                      (unsigned long long)parsed_message->content_received);
+            failed = 1;
+        }
+        else if (res->fsync_policy != FSYNC_NONE && fdatasync(file_fd) != 0)
+        {
+            log_write(LOG_ERROR, "%s: fdatasync: %s\n", tmp_path, strerror(errno));
+            failed = 1;
+        }
+        if (close(file_fd) != 0) failed = 1;
+        if (failed) { unlink(tmp_path); return NULL; }
 
-        /* content_size == 0 is valid — fopen "wb" already truncated the file */
-        size_t total_written = 0;
-        while (total_written < content_size)
+        pthread_mutex_lock(&res->commit_lock);
+        if (rename(tmp_path, res->filename) != 0)
         {
-            size_t written = fwrite(parsed_message->content + total_written, 1,
-                                    content_size - total_written, file_fd);
-            if (written == 0) { fclose(file_fd); pthread_rwlock_unlock(&res->rwlock); return NULL; }
-            total_written += written;
+            log_write(LOG_ERROR, "%s: rename: %s\n", res->filename, strerror(errno));
+            pthread_mutex_unlock(&res->commit_lock);
+            unlink(tmp_path);
+            return NULL;
         }
-        fclose(file_fd);
-        pthread_rwlock_unlock(&res->rwlock);
+        /* Bump before invalidating: a GET that re-caches the old version
+           after the invalidation is bound to see the new generation. */
+        __atomic_add_fetch(&res->generation, 1, __ATOMIC_SEQ_CST);
+        file_cache_invalidate(&g_file_cache, res->filename);
+        pthread_mutex_unlock(&res->commit_lock);
+
+        /* The rename itself is only durable once the directory is. */
+        if (res->fsync_policy == FSYNC_FULL) fsync_parent_dir(res->filename);
 
         size_t dlen = strlen(DEFAULT_RESPONSE);
-        char *body = malloc(dlen + 1);
+        char *body = msg_alloc(parsed_message, dlen + 1);
         if (body == NULL) return NULL;
         memcpy(body, DEFAULT_RESPONSE, dlen + 1);
         *body_size = dlen;
@@ -658,7 +1427,7 @@ size_t http_build_response(http_error_code error, http_message_t *parsed_message
     {
     case HTTP_Version_Not_Supported:
         body_size = sizeof(hvsb) - 1;
-        body_data = malloc(body_size);
+        body_data = msg_alloc(parsed_message, body_size);
         if (body_data) memcpy(body_data, hvsb, body_size);
         break;
 
@@ -675,7 +1444,7 @@ size_t http_build_response(http_error_code error, http_message_t *parsed_message
             error = Internal_Server_Error;
             goto build_error_body;
         }
-        body_data = method_action(parsed_message, &body_size);
+        body_data = method_action(parsed_message, client_fd, &body_size);
         if (body_data != NULL) break;
         error = Internal_Server_Error;
         /* fallthrough */
@@ -687,7 +1456,7 @@ size_t http_build_response(http_error_code error, http_message_t *parsed_message
     case Internal_Server_Error:
     default:
         body_size = strlen(DEFAULT_RESPONSE);
-        body_data = malloc(body_size + 1);
+        body_data = msg_alloc(parsed_message, body_size + 1);
         if (body_data) memcpy(body_data, DEFAULT_RESPONSE, body_size + 1);
         break;
     }
@@ -706,13 +1475,13 @@ size_t http_build_response(http_error_code error, http_message_t *parsed_message
     log_write(LOG_DEBUG, "Response body size: %zu\n", body_size);
     log_write(LOG_DEBUG, "Response size: %zu\n", response_size);
 
-    *response = malloc(response_size + 1);
-    if (*response == NULL) { free(body_data); return 0; }
+    *response = msg_alloc(parsed_message, response_size + 1);
+    if (*response == NULL) { msg_free(parsed_message, body_data); return 0; }
 
     memcpy(*response,               status_line, (size_t)slen);
     memcpy(*response + (size_t)slen, body_data,  body_size);
     (*response)[response_size] = '\0';
-    free(body_data);
+    msg_free(parsed_message, body_data);
 
     return response_size;
 }
@@ -721,6 +1490,15 @@ void http_message_free(http_message_t *message)
 {
     if (message == NULL) return;
 
+    if (message->arena != NULL)
+    {
+        arena_t *arena = message->arena;
+        arena_reset(arena);
+        memset(message, 0, sizeof(*message));
+        message->arena = arena;
+        return;
+    }
+
     free(message->request_line.method);
     free(message->request_line.target_resource);
     message->request_line.method          = NULL;
@@ -739,6 +1517,10 @@ void http_message_free(http_message_t *message)
     free(message->headers.accept_language);
     free(message->headers.accept);
     free(message->headers.origin);
+    free(message->headers.range);
+    free(message->headers.if_range);
+    free(message->headers.if_none_match);
+    free(message->headers.if_modified_since);
     message->headers.host             = NULL;
     message->headers.connection       = NULL;
     message->headers.content_length   = NULL;
@@ -748,7 +1530,18 @@ void http_message_free(http_message_t *message)
     message->headers.accept_language  = NULL;
     message->headers.accept           = NULL;
     message->headers.origin           = NULL;
+    message->headers.range            = NULL;
+    message->headers.if_range         = NULL;
+    message->headers.if_none_match    = NULL;
+    message->headers.if_modified_since = NULL;
 
     free((void *)message->content);
-    message->content = NULL;
+    free(message->chunked);
+    message->content          = NULL;
+    message->content_received = 0;
+    message->chunked          = NULL;
+
+    free((void *)message->request);
+    message->request = NULL;
+    message->raw     = NULL;
 }
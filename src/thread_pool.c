@@ -1,88 +1,650 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/futex.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include "../include/thread_pool.h"
 
-static void *worker_loop(void *arg)
-{
-    thread_pool_t *pool = (thread_pool_t *)arg;
-
-    for (;;)
-    {
-        pthread_mutex_lock(&pool->lock);
-        while (pool->queue_size == 0)
-            pthread_cond_wait(&pool->not_empty, &pool->lock);
-
-        int client_fd = pool->queue[pool->queue_head];
-        pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
-        pool->queue_size--;
-        pthread_mutex_unlock(&pool->lock);
+static void pool_grow(thread_pool_t *pool);
 
-        pool->work_fn(client_fd);
-    }
-    return NULL;
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-int thread_pool_init(thread_pool_t *pool,
-                     size_t worker_count,
-                     size_t queue_capacity,
-                     tp_work_fn work_fn)
+/* Called by a worker that has been parked for the idle timeout. Returns 1
+   if it may exit, leaving at least min_workers running. */
+static int pool_retire(thread_pool_t *pool)
 {
-    if (pool == NULL || worker_count == 0 || queue_capacity == 0 || work_fn == NULL)
-        return -1;
+    uint32_t live = __atomic_load_n(&pool->live, __ATOMIC_RELAXED);
+    while (live > pool->min_workers)
+        if (__atomic_compare_exchange_n(&pool->live, &live, live - 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return 1;
+    return 0;
+}
 
-    pool->workers = malloc(worker_count * sizeof(pthread_t));
-    if (pool->workers == NULL) return -1;
+#ifdef THREAD_POOL_MUTEX
+
+/*----------------------------------------------*/
+/*          Mutex + condition variable          */
+/*----------------------------------------------*/
 
-    pool->queue = malloc(queue_capacity * sizeof(int));
-    if (pool->queue == NULL) { free(pool->workers); return -1; }
+static int queue_init(thread_pool_t *pool, size_t capacity)
+{
+    pool->queue = malloc(capacity * sizeof(tp_task_t));
+    if (pool->queue == NULL) return -1;
 
-    pool->worker_count   = worker_count;
-    pool->queue_capacity = queue_capacity;
+    pool->queue_capacity = capacity;
     pool->queue_head     = 0;
     pool->queue_tail     = 0;
     pool->queue_size     = 0;
-    pool->work_fn        = work_fn;
+    pool->idle           = 0;
+
+    /* Idle timeouts are measured on the monotonic clock. */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
 
-    if (pthread_mutex_init(&pool->lock, NULL) != 0) goto fail_alloc;
-    if (pthread_cond_init(&pool->not_empty, NULL) != 0)
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) goto fail;
+    if (pthread_cond_init(&pool->not_empty, &attr) != 0)
     {
         pthread_mutex_destroy(&pool->lock);
-        goto fail_alloc;
+        goto fail;
     }
+    pthread_condattr_destroy(&attr);
+    return 0;
+
+fail:
+    pthread_condattr_destroy(&attr);
+    free(pool->queue);
+    return -1;
+}
 
-    for (size_t i = 0; i < worker_count; i++)
+/* Returns 0 with a task, or -1 once the worker should retire. */
+static int queue_pop(tp_worker_t *self, tp_task_t *task)
+{
+    thread_pool_t *pool = self->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->queue_size == 0)
     {
-        if (pthread_create(&pool->workers[i], NULL, worker_loop, pool) != 0)
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += pool->idle_timeout_ms / 1000;
+        deadline.tv_nsec += (long)(pool->idle_timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+
+        pool->idle++;
+        int rc = pthread_cond_timedwait(&pool->not_empty, &pool->lock, &deadline);
+        pool->idle--;
+
+        if (rc == ETIMEDOUT && pool->queue_size == 0 && pool_retire(pool))
         {
-            /* Best-effort: workers already created keep running; we only fail
-               the init call. In practice this only happens at startup. */
+            pthread_mutex_unlock(&pool->lock);
             return -1;
         }
     }
-    return 0;
 
-fail_alloc:
-    free(pool->queue);
-    free(pool->workers);
-    return -1;
+    *task = pool->queue[pool->queue_head];
+    pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+    pool->queue_size--;
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
 }
 
-int thread_pool_submit(thread_pool_t *pool, int client_fd)
+int thread_pool_submit_task(thread_pool_t *pool, tp_task_t task)
 {
     pthread_mutex_lock(&pool->lock);
 
     if (pool->queue_size == pool->queue_capacity)
     {
         pthread_mutex_unlock(&pool->lock);
-        close(client_fd);
         return -1;
     }
 
-    pool->queue[pool->queue_tail] = client_fd;
+    pool->queue[pool->queue_tail] = task;
     pool->queue_tail = (pool->queue_tail + 1) % pool->queue_capacity;
     pool->queue_size++;
 
+    /* Another task still waits and nobody is free to take this one. */
+    int grow = (pool->queue_size > 1 && pool->idle == 0);
+
     pthread_cond_signal(&pool->not_empty);
     pthread_mutex_unlock(&pool->lock);
+
+    if (grow) pool_grow(pool);
+    return 0;
+}
+
+int thread_pool_requeue(thread_pool_t *pool, tp_task_t task)
+{
+    return thread_pool_submit_task(pool, task);
+}
+
+static void queue_stats(thread_pool_t *pool, tp_stats_t *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    stats->idle   = pool->idle;
+    stats->queued = pool->queue_size;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#else
+
+#define TP_SPIN     200         /* empty polls before a worker parks */
+
+/* The worker running the calling thread, NULL outside the pools. */
+static __thread tp_worker_t *tls_worker;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Returns -1 if `timeout_ms` passed without a wake-up. */
+static int futex_wait(uint32_t *addr, uint32_t expected, unsigned timeout_ms)
+{
+    struct timespec timeout = { .tv_sec  = timeout_ms / 1000,
+                                .tv_nsec = (long)(timeout_ms % 1000) * 1000000L };
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0) != 0 && errno == ETIMEDOUT)
+        return -1;
     return 0;
 }
+
+static void futex_wake_one(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*----------------------------------------------*/
+/*             Lock-free MPMC ring              */
+/*----------------------------------------------*/
+
+static int ring_init(tp_ring_t *ring, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    ring->slots = malloc(size * sizeof(tp_slot_t));
+    if (ring->slots == NULL) return -1;
+
+    for (size_t i = 0; i < size; i++)
+        ring->slots[i].seq = i;
+    ring->mask        = size - 1;
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+    return 0;
+}
+
+/* A slot is free for the producer at `pos` when seq == pos, and holds a
+   task for the consumer at `pos` when seq == pos + 1. Claiming a position
+   is the only contended step: one CAS, no lock. */
+static int ring_push(tp_ring_t *ring, tp_task_t task)
+{
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        tp_slot_t *slot = &ring->slots[pos & ring->mask];
+        uint64_t   seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t    diff = (int64_t)(seq - pos);
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                slot->task = task;
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        }
+        else if (diff < 0)
+            return -1;                                  /* full */
+        else
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    }
+}
+
+/* Tasks pushed and not yet popped, give or take those in flight. */
+static size_t ring_depth(tp_ring_t *ring)
+{
+    uint64_t enq = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    uint64_t deq = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    return (enq > deq) ? (size_t)(enq - deq) : 0;
+}
+
+/* Returns 0 with a task, or -1 if the ring is empty (or its next task is
+   not published yet, which the producer follows with a wake-up). */
+static int ring_pop(tp_ring_t *ring, tp_task_t *task)
+{
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        tp_slot_t *slot = &ring->slots[pos & ring->mask];
+        uint64_t   seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t    diff = (int64_t)(seq - (pos + 1));
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *task = slot->task;
+                __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        }
+        else if (diff < 0)
+            return -1;                                  /* empty */
+        else
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    }
+}
+
+/*----------------------------------------------*/
+/*             Chase-Lev deque                  */
+/*----------------------------------------------*/
+
+/* Bounded, so a slot is only rewritten once `top` has passed it: a thief
+   that read a task and then wins the CAS on `top` read it intact. Task
+   fields are moved with relaxed atomics since a losing thief may read a
+   slot while the owner rewrites it. */
+static inline void task_store(tp_task_t *slot, tp_task_t task)
+{
+    __atomic_store_n(&slot->fn, task.fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->fd, task.fd, __ATOMIC_RELAXED);
+}
+
+static inline tp_task_t task_load(tp_task_t *slot)
+{
+    tp_task_t task;
+    task.fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+    task.fd = __atomic_load_n(&slot->fd, __ATOMIC_RELAXED);
+    return task;
+}
+
+static int deque_init(tp_deque_t *deque)
+{
+    deque->tasks  = malloc(TP_DEQUE_SIZE * sizeof(tp_task_t));
+    deque->top    = 0;
+    deque->bottom = 0;
+    return (deque->tasks != NULL) ? 0 : -1;
+}
+
+/* Owner only. */
+static int deque_push(tp_deque_t *deque, tp_task_t task)
+{
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (b - t >= TP_DEQUE_SIZE) return -1;
+
+    task_store(&deque->tasks[b & (TP_DEQUE_SIZE - 1)], task);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Owner only: newest first. Only the last task is contended, and a CAS on
+   `top` settles it against thieves. */
+static int deque_pop(tp_deque_t *deque, tp_task_t *task)
+{
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (t > b)
+    {
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    *task = task_load(&deque->tasks[b & (TP_DEQUE_SIZE - 1)]);
+    if (t < b) return 0;
+
+    int won = __atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return won ? 0 : -1;
+}
+
+/* Any thread: oldest first. */
+static int deque_steal(tp_deque_t *deque, tp_task_t *task)
+{
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return -1;
+
+    tp_task_t stolen = task_load(&deque->tasks[t & (TP_DEQUE_SIZE - 1)]);
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return -1;
+    *task = stolen;
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*             Scheduling                       */
+/*----------------------------------------------*/
+
+static int queue_init(thread_pool_t *pool, size_t capacity)
+{
+    if (pool->mode == TP_SHARED)
+        return ring_init(&pool->ring, capacity);
+
+    /* The capacity is split between the inboxes of the minimum set of
+       workers; each worker added under load brings as much again. */
+    size_t per_worker = (capacity + pool->min_workers - 1) / pool->min_workers;
+    for (size_t i = 0; i < pool->max_workers; i++)
+        if (ring_init(&pool->workers[i].inbox, per_worker) != 0 ||
+            deque_init(&pool->workers[i].deque) != 0)
+            return -1;
+    return 0;
+}
+
+/* One look for work: TP_SHARED has a single ring. A stealing worker tries
+   its own follow-ups, then what was submitted to it, then the other
+   workers' deques and inboxes, starting after itself so thieves spread.
+   Slots whose worker retired are searched too: a submitter may have picked
+   one just before. */
+static int find_task(tp_worker_t *self, tp_task_t *task)
+{
+    thread_pool_t *pool = self->pool;
+    if (pool->mode == TP_SHARED)
+        return ring_pop(&pool->ring, task);
+
+    if (deque_pop(&self->deque, task) == 0)  return 0;
+    if (ring_pop(&self->inbox, task) == 0)   return 0;
+
+    size_t slots = __atomic_load_n(&pool->slots_used, __ATOMIC_ACQUIRE);
+    for (size_t i = 1; i < slots; i++)
+    {
+        tp_worker_t *victim = &pool->workers[(self->index + i) % slots];
+        if (deque_steal(&victim->deque, task) == 0) return 0;
+        if (ring_pop(&victim->inbox, task) == 0)    return 0;
+    }
+    return -1;
+}
+
+/* Tasks waiting in any queue, approximate. */
+static size_t queue_backlog(thread_pool_t *pool)
+{
+    if (pool->mode == TP_SHARED)
+        return ring_depth(&pool->ring);
+
+    size_t slots = __atomic_load_n(&pool->slots_used, __ATOMIC_ACQUIRE);
+    size_t queued = 0;
+    for (size_t i = 0; i < slots; i++)
+    {
+        tp_worker_t *w = &pool->workers[i];
+        int64_t local = __atomic_load_n(&w->deque.bottom, __ATOMIC_RELAXED) -
+                        __atomic_load_n(&w->deque.top,    __ATOMIC_RELAXED);
+        queued += ring_depth(&w->inbox) + (size_t)(local > 0 ? local : 0);
+    }
+    return queued;
+}
+
+/* One task was added, so one sleeper is enough; busy workers find it on
+   their next look. Until a sleeper leaves after a wake-up, further
+   submits skip the syscall: on a busy core the woken worker may not run
+   for a while, and the tasks behind it are handed on when it does.
+   Sleepers clear wake_pending after counting themselves, and the seq bump
+   comes after setting it, so a sleeper it skips cannot be parked on the
+   old seq. Returns 0 if nobody was parked. */
+static int wake_one(thread_pool_t *pool)
+{
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) == 0) return 0;
+    if (__atomic_exchange_n(&pool->wake_pending, 1, __ATOMIC_SEQ_CST)) return 1;
+
+    __atomic_add_fetch(&pool->wake_seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake_one(&pool->wake_seq);
+    return 1;
+}
+
+/* Spin briefly, then park on the futex. A worker counts itself in
+   `sleepers` before its last look for work, and a producer reads
+   `sleepers` after publishing (both seq_cst), so either the worker sees
+   the task or the producer sees the worker and bumps wake_seq, which
+   makes the futex wait return at once if it has not started yet.
+   Returns 0 with a task, or -1 once the worker should retire. */
+static int queue_pop(tp_worker_t *self, tp_task_t *task)
+{
+    thread_pool_t *pool = self->pool;
+
+    for (;;)
+    {
+        for (int i = 0; i < TP_SPIN; i++)
+        {
+            if (find_task(self, task) == 0) return 0;
+            cpu_relax();
+        }
+
+        uint32_t seq = __atomic_load_n(&pool->wake_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&pool->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+        int found     = (find_task(self, task) == 0);
+        int timed_out = !found && futex_wait(&pool->wake_seq, seq, pool->idle_timeout_ms) != 0;
+
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&pool->wake_pending, 0, __ATOMIC_SEQ_CST);
+        if (found) return 0;
+
+        /* Tasks submitted while this worker was being woken did not wake
+           anyone else: pass one on if they are still waiting. */
+        if (!timed_out && find_task(self, task) == 0)
+        {
+            if (queue_backlog(pool) > 0) wake_one(pool);
+            return 0;
+        }
+
+        /* A wake-up may have gone to this worker just before it stopped
+           counting as a sleeper: look once more before leaving. */
+        if (timed_out)
+        {
+            if (find_task(self, task) == 0) return 0;
+            if (pool_retire(pool)) return -1;
+        }
+    }
+}
+
+int thread_pool_submit_task(thread_pool_t *pool, tp_task_t task)
+{
+    tp_ring_t *ring = NULL;
+    if (pool->mode == TP_SHARED)
+    {
+        if (ring_push(&pool->ring, task) == 0) ring = &pool->ring;
+    }
+    else
+    {
+        /* Round-robin over the running workers' inboxes, passing over
+           full ones. */
+        size_t   slots = __atomic_load_n(&pool->slots_used, __ATOMIC_ACQUIRE);
+        uint64_t first = __atomic_fetch_add(&pool->next_worker, 1, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < slots && ring == NULL; i++)
+        {
+            tp_worker_t *w = &pool->workers[(first + i) % slots];
+            if (__atomic_load_n(&w->running, __ATOMIC_RELAXED) && ring_push(&w->inbox, task) == 0)
+                ring = &w->inbox;
+        }
+    }
+    if (ring == NULL) return -1;
+
+    /* Another task still waits and nobody is free to take this one. */
+    if (!wake_one(pool) && ring_depth(ring) > 1)
+        pool_grow(pool);
+    return 0;
+}
+
+int thread_pool_requeue(thread_pool_t *pool, tp_task_t task)
+{
+    tp_worker_t *self = tls_worker;
+    if (pool->mode == TP_STEALING && self != NULL && self->pool == pool &&
+        deque_push(&self->deque, task) == 0)
+    {
+        wake_one(pool);
+        return 0;
+    }
+    return thread_pool_submit_task(pool, task);
+}
+
+static void queue_stats(thread_pool_t *pool, tp_stats_t *stats)
+{
+    stats->idle   = __atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED);
+    stats->queued = queue_backlog(pool);
+}
+
+#endif // THREAD_POOL_MUTEX
+
+/*----------------------------------------------*/
+/*                  Workers                     */
+/*----------------------------------------------*/
+
+static void *worker_loop(void *arg)
+{
+    tp_worker_t   *self = (tp_worker_t *)arg;
+    thread_pool_t *pool = self->pool;
+#ifndef THREAD_POOL_MUTEX
+    tls_worker = self;
+#endif
+
+    /* Best-effort, like the shard's acceptor: an unpinned worker still works. */
+    if (pool->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(pool->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    tp_task_t task;
+    while (queue_pop(self, &task) == 0)
+    {
+        uint64_t start = now_ns();
+        task.fn(task.fd);
+        __atomic_add_fetch(&self->busy_ns, now_ns() - start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&self->tasks, 1, __ATOMIC_RELAXED);
+    }
+
+    /* pool_retire() already took this thread off `live`; freeing the slot
+       is the last thing it does. */
+    __atomic_add_fetch(&pool->retired, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->running, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Start a detached worker in the first free slot. Only one thread spawns
+   at a time: init, then whichever submitter holds `spawning`. */
+static int spawn_worker(thread_pool_t *pool)
+{
+    tp_worker_t *w = NULL;
+    for (size_t i = 0; i < pool->max_workers && w == NULL; i++)
+        if (!__atomic_load_n(&pool->workers[i].running, __ATOMIC_ACQUIRE))
+            w = &pool->workers[i];
+    if (w == NULL) return -1;           /* a retiring thread still holds its slot */
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    __atomic_store_n(&w->running, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->live, 1, __ATOMIC_RELAXED);
+    if (w->index + 1 > pool->slots_used)
+        __atomic_store_n(&pool->slots_used, w->index + 1, __ATOMIC_RELEASE);
+
+    int rc = pthread_create(&w->thread, &attr, worker_loop, w);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        __atomic_sub_fetch(&pool->live, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&w->running, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 0;
+}
+
+static void pool_grow(thread_pool_t *pool)
+{
+    if (__atomic_load_n(&pool->live, __ATOMIC_RELAXED) >= pool->max_workers) return;
+    if (__atomic_exchange_n(&pool->spawning, 1, __ATOMIC_ACQUIRE)) return;
+
+    if (__atomic_load_n(&pool->live, __ATOMIC_RELAXED) < pool->max_workers && spawn_worker(pool) == 0)
+        __atomic_add_fetch(&pool->spawned, 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&pool->spawning, 0, __ATOMIC_RELEASE);
+}
+
+int thread_pool_init(thread_pool_t *pool, const tp_config_t *config, tp_work_fn work_fn)
+{
+    if (pool == NULL || config == NULL || config->min_workers == 0 ||
+        config->queue_capacity == 0 || work_fn == NULL)
+        return -1;
+
+    pool->min_workers     = config->min_workers;
+    pool->max_workers     = (config->max_workers > config->min_workers) ? config->max_workers
+                                                                        : config->min_workers;
+    pool->idle_timeout_ms = (config->idle_timeout_ms > 0) ? config->idle_timeout_ms : 1;
+    pool->cpu             = config->cpu;
+    pool->work_fn         = work_fn;
+#ifdef THREAD_POOL_MUTEX
+    pool->mode            = TP_SHARED;
+#else
+    pool->mode            = config->mode;
+#endif
+
+    pool->workers = calloc(pool->max_workers, sizeof(tp_worker_t));
+    if (pool->workers == NULL) return -1;
+
+    for (size_t i = 0; i < pool->max_workers; i++)
+    {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+    }
+
+    /* On failure the queues allocated so far are left behind, like the
+       workers below: this only happens at startup. */
+    if (queue_init(pool, config->queue_capacity) != 0) return -1;
+
+    for (size_t i = 0; i < pool->min_workers; i++)
+    {
+        if (spawn_worker(pool) != 0)
+        {
+            /* Best-effort: workers already created keep running; we only fail
+               the init call. In practice this only happens at startup. */
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int thread_pool_submit(thread_pool_t *pool, int client_fd)
+{
+    tp_task_t task = { pool->work_fn, client_fd };
+    return thread_pool_submit_task(pool, task);
+}
+
+void thread_pool_get_stats(thread_pool_t *pool, tp_stats_t *stats)
+{
+    stats->workers     = __atomic_load_n(&pool->live,    __ATOMIC_RELAXED);
+    stats->min_workers = pool->min_workers;
+    stats->max_workers = pool->max_workers;
+    stats->spawned     = __atomic_load_n(&pool->spawned, __ATOMIC_RELAXED);
+    stats->retired     = __atomic_load_n(&pool->retired, __ATOMIC_RELAXED);
+    stats->tasks       = 0;
+    stats->busy_ns     = 0;
+    for (size_t i = 0; i < pool->max_workers; i++)
+    {
+        stats->tasks   += __atomic_load_n(&pool->workers[i].tasks,   __ATOMIC_RELAXED);
+        stats->busy_ns += __atomic_load_n(&pool->workers[i].busy_ns, __ATOMIC_RELAXED);
+    }
+    queue_stats(pool, stats);
+}
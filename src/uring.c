@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "../include/uring.h"
+#include "../include/utils.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(uring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->ring_fd = sys_setup(entries, &p);
+    if (ring->ring_fd < 0) return -1;
+
+    /* Every kernel with the features we rely on maps SQ and CQ together. */
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) goto fail;
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_len = (sq_len > cq_len) ? sq_len : cq_len;
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->ring_ptr = mmap(NULL, ring->ring_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) goto fail;
+
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        munmap(ring->ring_ptr, ring->ring_len);
+        goto fail;
+    }
+
+    char *base = ring->ring_ptr;
+    ring->sq_head  = (unsigned *)(base + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)(base + p.sq_off.tail);
+    ring->sq_mask  = *(unsigned *)(base + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(base + p.sq_off.array);
+    ring->cq_head  = (unsigned *)(base + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)(base + p.cq_off.tail);
+    ring->cq_mask  = *(unsigned *)(base + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+
+    /* Identity-map the indirection array once; slots are used in order. */
+    for (unsigned i = 0; i <= ring->sq_mask; i++)
+        ring->sq_array[i] = i;
+    ring->sqe_tail = *ring->sq_tail;
+    return 0;
+
+fail:
+    close(ring->ring_fd);
+    return -1;
+}
+
+void uring_exit(uring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    munmap(ring->ring_ptr, ring->ring_len);
+    close(ring->ring_fd);
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head > ring->sq_mask) return NULL;
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit(uring_t *ring, unsigned wait_nr)
+{
+    unsigned to_submit = ring->sqe_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    int ret = sys_enter(ring->ring_fd, to_submit, wait_nr,
+                        wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    return (ret < 0) ? -errno : ret;
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *ring)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) return NULL;
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static struct io_uring_buf_ring *buf_ring_register(uring_t *ring, unsigned entries, size_t *len)
+{
+    *len = entries * sizeof(struct io_uring_buf);
+    struct io_uring_buf_ring *br = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br == MAP_FAILED) return NULL;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = entries;
+    reg.bgid         = URING_BUF_GROUP;
+
+    if (sys_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        munmap(br, *len);
+        return NULL;
+    }
+    return br;
+}
+
+int uring_supported(void)
+{
+    uring_t ring;
+    if (uring_init(&ring, 8) != 0) return 0;
+
+    int ok = 0;
+    size_t probe_len = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_len);
+    if (probe != NULL &&
+        sys_register(ring.ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0)
+    {
+        static const int needed[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                                      IORING_OP_SPLICE, IORING_OP_READ };
+        ok = 1;
+        for (size_t i = 0; i < sizeof(needed)/sizeof(needed[0]); i++)
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+                ok = 0;
+    }
+    free(probe);
+
+    /* Provided buffer rings arrived together with multishot accept (5.19). */
+    if (ok)
+    {
+        size_t len;
+        struct io_uring_buf_ring *br = buf_ring_register(&ring, 1, &len);
+        if (br == NULL) ok = 0;
+        else munmap(br, len);
+    }
+
+    uring_exit(&ring);
+    return ok;
+}
+
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs)
+{
+    bufs->base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (bufs->base == NULL) return -1;
+
+    bufs->ring = buf_ring_register(ring, URING_BUF_COUNT, &bufs->ring_len);
+    if (bufs->ring == NULL) { free(bufs->base); return -1; }
+
+    bufs->tail = 0;
+    for (uint16_t bid = 0; bid < URING_BUF_COUNT; bid++)
+        uring_buf_ring_recycle(bufs, bid);
+    return 0;
+}
+
+char *uring_buf_ring_get(uring_buf_ring_t *bufs, uint16_t bid)
+{
+    return bufs->base + (size_t)bid * URING_BUF_SIZE;
+}
+
+void uring_buf_ring_recycle(uring_buf_ring_t *bufs, uint16_t bid)
+{
+    struct io_uring_buf *buf = &bufs->ring->bufs[bufs->tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_get(bufs, bid);
+    buf->len  = URING_BUF_SIZE;
+    buf->bid  = bid;
+    bufs->tail++;
+    __atomic_store_n(&bufs->ring->tail, bufs->tail, __ATOMIC_RELEASE);
+}
+
+/*----------------------------------------------*/
+/*        Per-worker ring for file bodies       */
+/*----------------------------------------------*/
+
+typedef struct send_ctx_s
+{
+    int     state;          /* 0 = not tried, 1 = ready, -1 = unavailable */
+    uring_t ring;
+    int     pipe_fd[2];
+    size_t  pipe_size;
+} send_ctx_t;
+
+static __thread send_ctx_t t_send;
+static pthread_key_t       g_send_key;
+static pthread_once_t      g_send_once = PTHREAD_ONCE_INIT;
+
+/* A worker is retiring: the elastic pool starts new ones under load, so
+   each would otherwise leave a ring and a pipe behind. */
+static void send_ctx_release(void *arg)
+{
+    send_ctx_t *ctx = arg;
+    uring_exit(&ctx->ring);
+    close(ctx->pipe_fd[0]);
+    close(ctx->pipe_fd[1]);
+    ctx->state = 0;
+}
+
+static void send_key_init(void)
+{
+    pthread_key_create(&g_send_key, send_ctx_release);
+}
+
+static send_ctx_t *send_ctx(void)
+{
+    send_ctx_t *ctx = &t_send;
+    if (ctx->state != 0) return (ctx->state > 0) ? ctx : NULL;
+
+    pthread_once(&g_send_once, send_key_init);
+    ctx->state = -1;
+    if (uring_init(&ctx->ring, URING_SEND_ENTRIES) != 0) return NULL;
+    if (pipe2(ctx->pipe_fd, O_CLOEXEC) != 0) { uring_exit(&ctx->ring); return NULL; }
+
+    fcntl(ctx->pipe_fd[1], F_SETPIPE_SZ, URING_PIPE_SIZE);
+    int size = fcntl(ctx->pipe_fd[1], F_GETPIPE_SZ);
+    ctx->pipe_size = (size > 0) ? (size_t)size : 65536;
+    ctx->state = 1;
+    pthread_setspecific(g_send_key, ctx);
+    return ctx;
+}
+
+/* Submit everything queued and collect `count` results indexed by user_data. */
+static int send_ctx_run(send_ctx_t *ctx, int *res, unsigned count)
+{
+    unsigned seen = 0;
+    int ret = uring_submit(&ctx->ring, count);
+    while (seen < count)
+    {
+        if (ret < 0 && ret != -EINTR) return -1;
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ctx->ring)) != NULL)
+        {
+            res[cqe->user_data] = cqe->res;
+            uring_cqe_seen(&ctx->ring);
+            seen++;
+        }
+        if (seen < count) ret = uring_submit(&ctx->ring, count - seen);
+    }
+    return 0;
+}
+
+static void prep_splice(struct io_uring_sqe *sqe, int in_fd, int64_t in_off,
+                        int out_fd, size_t len, uint64_t user_data)
+{
+    sqe->opcode        = IORING_OP_SPLICE;
+    sqe->splice_fd_in  = in_fd;
+    sqe->splice_off_in = (uint64_t)in_off;
+    sqe->fd            = out_fd;
+    sqe->off           = (uint64_t)-1;
+    sqe->len           = (unsigned)len;
+    sqe->splice_flags  = SPLICE_F_MOVE;
+    sqe->user_data     = user_data;
+}
+
+/* Push whatever a broken chain left in the pipe out to the socket. */
+static int send_ctx_drain(send_ctx_t *ctx, int sock_fd, size_t pending)
+{
+    while (pending > 0)
+    {
+        int res;
+        struct io_uring_sqe *sqe = uring_get_sqe(&ctx->ring);
+        prep_splice(sqe, ctx->pipe_fd[0], -1, sock_fd, pending, 0);
+        if (send_ctx_run(ctx, &res, 1) != 0) return -1;
+
+        if (res == -EAGAIN || res == -EINTR)
+        {
+            struct pollfd pfd = { .fd = sock_fd, .events = POLLOUT };
+            if (poll(&pfd, 1, IO_TIMEOUT_MS) <= 0) return -1;
+            continue;
+        }
+        if (res <= 0) return -1;
+        pending -= (size_t)res;
+    }
+    return 0;
+}
+
+int uring_send_file(int sock_fd, const void *head, size_t head_len,
+                    int file_fd, off_t offset, size_t count)
+{
+    send_ctx_t *ctx = send_ctx();
+    if (ctx == NULL)
+    {
+        if (send_all(sock_fd, head, head_len) != 0) return -1;
+        return sendfile_all(sock_fd, file_fd, offset, count);
+    }
+
+    int    res[URING_SEND_ENTRIES];
+    size_t chunk[URING_SEND_ENTRIES];
+    size_t head_sent = 0;
+    size_t total     = head_len + count;
+
+    while (head_sent < head_len || count > 0)
+    {
+        /* One chain per round: [send head] -> (file->pipe -> pipe->socket)*. */
+        unsigned n = 0;
+        struct io_uring_sqe *sqe = NULL;
+
+        if (head_sent < head_len)
+        {
+            sqe = uring_get_sqe(&ctx->ring);
+            sqe->opcode    = IORING_OP_SEND;
+            sqe->fd        = sock_fd;
+            sqe->addr      = (uint64_t)(uintptr_t)((const char *)head + head_sent);
+            sqe->len       = (unsigned)(head_len - head_sent);
+            sqe->msg_flags = MSG_NOSIGNAL | (count > 0 ? MSG_MORE : 0);
+            sqe->flags     = IOSQE_IO_LINK;
+            sqe->user_data = n;
+            chunk[n++]     = head_len - head_sent;
+        }
+
+        size_t queued = 0;
+        while (queued < count && n + 2 <= URING_SEND_ENTRIES)
+        {
+            size_t len = count - queued;
+            if (len > ctx->pipe_size) len = ctx->pipe_size;
+
+            sqe = uring_get_sqe(&ctx->ring);
+            prep_splice(sqe, file_fd, (int64_t)(offset + (off_t)queued), ctx->pipe_fd[1], len, n);
+            sqe->flags = IOSQE_IO_LINK;
+            chunk[n++] = len;
+
+            sqe = uring_get_sqe(&ctx->ring);
+            prep_splice(sqe, ctx->pipe_fd[0], -1, sock_fd, len, n);
+            sqe->flags = IOSQE_IO_LINK;
+            chunk[n++] = len;
+
+            queued += len;
+        }
+        sqe->flags &= ~IOSQE_IO_LINK;
+
+        if (send_ctx_run(ctx, res, n) != 0) return -1;
+
+        /* Walk the results; a short or failed step cancels the rest. */
+        unsigned i = 0;
+        if (head_sent < head_len)
+        {
+            if (res[0] < 0 && res[0] != -ECANCELED && res[0] != -EAGAIN) return -1;
+            if (res[0] > 0) head_sent += (size_t)res[0];
+            i = 1;
+            if (head_sent < head_len) continue;     /* nothing after it ran */
+        }
+
+        size_t in_pipe = 0, pulled = 0;
+        for (; i + 1 < n; i += 2)
+        {
+            int in = res[i], out = res[i + 1];
+            if ((in < 0 && in != -ECANCELED) || in == 0) return -1;
+            if (in < 0) break;
+            pulled  += (size_t)in;
+            in_pipe += (size_t)in;
+            if (out > 0) in_pipe -= (size_t)out;
+            else if (out != -ECANCELED && out != -EAGAIN) return -1;
+            if ((size_t)in != chunk[i] || out != in) break;
+        }
+
+        if (send_ctx_drain(ctx, sock_fd, in_pipe) != 0) return -1;
+        offset += (off_t)pulled;
+        count  -= pulled;
+    }
+    send_meter_add(head, total);
+    return 0;
+}
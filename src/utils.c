@@ -1,3 +1,11 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include "../include/scan.h"
 #include "../include/utils.h"
 
 char *strstrcpy(const char *src, size_t length)
@@ -17,12 +25,205 @@ void lowercase(char *string, size_t length)
     if(string == NULL)
         return;
 
-    int i = 0;
-    while ((string[i] != '\0') && (i<length))
+    g_scan.lower(string, string, strnlen(string, length));
+}
+
+uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+__thread send_meter_t t_send_meter;
+
+void send_meter_reset(void)
+{
+    t_send_meter.bytes  = 0;
+    t_send_meter.status = 0;
+}
+
+/* A response starts with its head, so the first "HTTP/1.x NNN" sent after
+   a reset carries the status. */
+static void meter_head(const void *buf, size_t length)
+{
+    const char *p = buf;
+    if (t_send_meter.status != 0 || t_send_meter.bytes != 0 || length < 12 ||
+        memcmp(p, "HTTP/1.", 7) != 0 || p[8] != ' ')
+        return;
+    if (p[9] >= '1' && p[9] <= '5' && p[10] >= '0' && p[10] <= '9' && p[11] >= '0' && p[11] <= '9')
+        t_send_meter.status = (uint16_t)((p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0'));
+}
+
+void send_meter_add(const void *buf, size_t sent)
+{
+    if (buf != NULL) meter_head(buf, sent);
+    t_send_meter.bytes += sent;
+}
+
+static int wait_for(int fd, short events)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int r;
+    do
+        r = poll(&pfd, 1, IO_TIMEOUT_MS);
+    while (r < 0 && errno == EINTR);
+    return (r > 0 && !(pfd.revents & (POLLERR | POLLNVAL))) ? 0 : -1;
+}
+
+int wait_readable(int fd)
+{
+    return wait_for(fd, POLLIN);
+}
+
+static int wait_writable(int fd)
+{
+    return wait_for(fd, POLLOUT);
+}
+
+int send_all(int fd, const void *buf, size_t length)
+{
+    size_t sent = 0;
+    meter_head(buf, length);
+    while (sent < length)
+    {
+        ssize_t n = send(fd, (const char *)buf + sent, length - sent, MSG_NOSIGNAL);
+        if (n > 0) { sent += (size_t)n; t_send_meter.bytes += (uint64_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd) == 0) continue;
+        return -1;
+    }
+    return 0;
+}
+
+int sendfile_all(int out_fd, int in_fd, off_t offset, size_t count)
+{
+    off_t end = offset + (off_t)count;
+    while (offset < end)
+    {
+        ssize_t n = sendfile(out_fd, in_fd, &offset, (size_t)(end - offset));
+        if (n > 0) { t_send_meter.bytes += (uint64_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(out_fd) == 0) continue;
+        return -1;
+    }
+    return 0;
+}
+
+int sendv_all(int fd, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)iovcnt };
+    ssize_t n = 0;
+
+    if (iovcnt > 0) meter_head(iov[0].iov_base, iov[0].iov_len);
+
+    for (;;)
+    {
+        /* Drop what went out (and empty entries): whole iovecs first, then
+           part of the next. */
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len)
+        {
+            n -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen == 0) return 0;
+        msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+        msg.msg_iov->iov_len -= (size_t)n;
+
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) { t_send_meter.bytes += (uint64_t)n; continue; }
+        if (n == 0) return -1;
+        n = 0;
+        if (errno == EINTR) continue;
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd) == 0) continue;
+        return -1;
+    }
+}
+
+int pread_all(int fd, void *buf, size_t length, off_t offset)
+{
+    size_t got = 0;
+    while (got < length)
+    {
+        ssize_t n = pread(fd, (char *)buf + got, length - got, offset + (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+int write_all(int fd, const void *buf, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t n = write(fd, (const char *)buf + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+#define RECV_CHUNK  (1u << 20)      /* pipe size asked for, and bytes per splice */
+#define RECV_BOUNCE (64u << 10)
+
+/* socket -> pipe -> file, never through userspace. Returns 1 if splice is
+   not supported for these fds (nothing was consumed). The socket may be
+   blocking (io_uring backend), so readiness is always polled first. */
+static int splice_to_file(int sock_fd, int file_fd, uint64_t count, uint64_t *moved)
+{
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) return 1;
+    fcntl(pipefd[1], F_SETPIPE_SZ, RECV_CHUNK);      /* best effort */
+
+    int rc = 0;
+    while (*moved < count)
+    {
+        if (wait_for(sock_fd, POLLIN) != 0) { rc = -1; break; }
+
+        uint64_t want = count - *moved;
+        ssize_t n = splice(sock_fd, NULL, pipefd[1], NULL, (want < RECV_CHUNK) ? (size_t)want : RECV_CHUNK,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n < 0 && errno == EINVAL && *moved == 0) { rc = 1; break; }
+        if (n <= 0) { rc = -1; break; }
+
+        for (ssize_t left = n; left > 0; )
+        {
+            ssize_t w = splice(pipefd[0], NULL, file_fd, NULL, (size_t)left, SPLICE_F_MOVE);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) { rc = -1; break; }
+            left -= w;
+        }
+        if (rc != 0) break;
+        *moved += (uint64_t)n;
+    }
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return rc;
+}
+
+int recv_to_file(int sock_fd, int file_fd, uint64_t count, uint64_t *moved)
+{
+    *moved = 0;
+    int rc = splice_to_file(sock_fd, file_fd, count, moved);
+    if (rc <= 0) return rc;
+
+    char buf[RECV_BOUNCE];
+    while (*moved < count)
     {
-        if (string[i] >= 'A' && string[i] <= 'Z')
-            string[i] += 32;
+        if (wait_for(sock_fd, POLLIN) != 0) return -1;
 
-        i++;
+        uint64_t want = count - *moved;
+        ssize_t n = recv(sock_fd, buf, (want < sizeof(buf)) ? (size_t)want : sizeof(buf), MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) return -1;
+        if (write_all(file_fd, buf, (size_t)n) != 0) return -1;
+        *moved += (uint64_t)n;
     }
+    return 0;
 }
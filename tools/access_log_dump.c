@@ -0,0 +1,122 @@
+/* Prints the records of a binary access log (see include/access_log.h),
+   oldest first, one line each: wall time, method, status, bytes sent,
+   keep-alive, resource id, target, then the time spent in each phase in
+   microseconds: idle (from the connection's accept to the request's
+   first byte), read (until the reactor dispatched it), queue (until a worker
+   took it), parse, validate, respond (until the last byte was sent) and
+   total (first byte to last). Safe to run against the log of a live server.
+
+   usage: access_log_dump FILE [LAST]     (LAST: only the newest LAST records) */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/access_log.h"
+#include "../include/http.h"
+
+#define X(method) #method,
+static const char *const methods[] = { HTTP_METHODS };
+#undef X
+
+/* Microseconds from `from` to `to`, "-" if either phase was not reached. */
+static void phase(char *out, size_t size, uint64_t from, uint64_t to)
+{
+    if (from == 0 || to == 0 || to < from) snprintf(out, size, "-");
+    else snprintf(out, size, "%.1f", (double)(to - from) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s FILE [LAST]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if ((size_t)st.st_size < sizeof(access_log_header_t))
+    {
+        fprintf(stderr, "%s: not an access log\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    const access_log_header_t *header  = map;
+    const access_record_t     *records = (const access_record_t *)(header + 1);
+    if (memcmp(header->magic, ACCESS_LOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ACCESS_LOG_VERSION || header->record_size != sizeof(access_record_t) ||
+        header->capacity == 0 ||
+        (size_t)st.st_size < sizeof(*header) + header->capacity * sizeof(access_record_t))
+    {
+        fprintf(stderr, "%s: not an access log (or a different version)\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t next  = __atomic_load_n(&header->next, __ATOMIC_ACQUIRE);
+    uint64_t first = (next > header->capacity) ? next - header->capacity : 0;
+    if (argc == 3)
+    {
+        uint64_t last = strtoull(argv[2], NULL, 10);
+        if (next - first > last) first = next - last;
+    }
+
+    printf("%-23s %-7s %3s %10s %2s %4s %-32s %9s %9s %9s %9s %9s %9s %9s\n",
+           "time", "method", "st", "bytes", "ka", "res", "target",
+           "idle", "read", "queue", "parse", "validate", "respond", "total");
+
+    for (uint64_t i = first; i < next; i++)
+    {
+        const access_record_t *slot = &records[i % header->capacity];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+
+        access_record_t r;
+        memcpy(&r, slot, sizeof(r));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != i + 1) continue;   /* overwritten meanwhile */
+        r.target[ACCESS_TARGET_MAX - 1] = '\0';
+
+        time_t    sec = (time_t)(r.wall_ns / 1000000000ull);
+        struct tm tm_buf;
+        char      ts[32];
+        localtime_r(&sec, &tm_buf);
+        size_t n = strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm_buf);
+        snprintf(ts + n, sizeof(ts) - n, ".%03u", (unsigned)(r.wall_ns / 1000000ull % 1000));
+
+        /* The worker's phases run back to back; a skipped one (no
+           validation after a 400) is folded into the next. */
+        uint64_t validated = r.validated_ns ? r.validated_ns : r.parsed_ns;
+        char idle[16], read[16], queue[16], parse[16], validate[16], respond[16], total[16];
+        phase(idle,     sizeof(idle),     r.accept_ns,     r.first_byte_ns);
+        phase(read,     sizeof(read),     r.first_byte_ns, r.dispatched_ns);
+        phase(queue,    sizeof(queue),    r.dispatched_ns, r.started_ns);
+        phase(parse,    sizeof(parse),    r.started_ns,    r.parsed_ns);
+        phase(validate, sizeof(validate), r.parsed_ns,     r.validated_ns);
+        phase(respond,  sizeof(respond),  validated,       r.last_byte_ns);
+        phase(total,    sizeof(total),    r.first_byte_ns, r.last_byte_ns);
+
+        printf("%-23s %-7s %3u %10llu %2s %4d %-32s %9s %9s %9s %9s %9s %9s %9s\n",
+               ts, (r.method < METHOD_COUNT) ? methods[r.method] : "?", (unsigned)r.status,
+               (unsigned long long)r.bytes_sent, r.keep_alive ? "ka" : "-", (int)r.resource_id,
+               r.target, idle, read, queue, parse, validate, respond, total);
+    }
+
+    munmap(map, (size_t)st.st_size);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+/* Shared bits of the tools/bench_*.c micro-benchmarks: a clock, a sink
+   the compiler cannot optimise away, and a best-of-N timing loop. */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_ROUNDS        5           /* report the fastest round */
+#define BENCH_ROUND_NS      200000000ull /* grow iterations until a round takes this long */
+
+static volatile uint64_t bench_sink;
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Nanoseconds per call of fn(arg), the best of BENCH_ROUNDS rounds, each
+   long enough to swamp the clock. fn returns a value folded into the sink. */
+static inline double bench_time(uint64_t (*fn)(void *), void *arg)
+{
+    uint64_t iters = 1;
+    for (;;)
+    {
+        uint64_t t0 = bench_now_ns(), acc = 0;
+        for (uint64_t i = 0; i < iters; i++) acc += fn(arg);
+        bench_sink += acc;
+        if (bench_now_ns() - t0 >= BENCH_ROUND_NS / 8 || iters >= (1ull << 40)) break;
+        iters *= 2;
+    }
+
+    double best = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        uint64_t t0 = bench_now_ns(), acc = 0;
+        for (uint64_t i = 0; i < iters * 8; i++) acc += fn(arg);
+        double ns = (double)(bench_now_ns() - t0) / (double)(iters * 8);
+        bench_sink += acc;
+        if (r == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+#endif // BENCH_H
@@ -0,0 +1,175 @@
+/* Contention benchmark of the worker pool (src/thread_pool.c): producer
+   threads submit empty tasks as fast as the queue takes them while the
+   workers run them, and the run reports tasks per second and the
+   submit-to-run latency percentiles. `make bench` builds it twice, as
+   bench_pool against the lock-free queues and bench_pool_mutex with
+   -DTHREAD_POOL_MUTEX, so the two can be run side by side.
+
+   usage: bench_pool [producers workers]
+
+   Without arguments it sweeps 1-8 producers against 1-8 workers. The pool
+   has no teardown, so each configuration runs in a child process. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/thread_pool.h"
+#include "bench.h"
+
+#define TASKS           (1u << 19)  /* per configuration, split between producers */
+#define QUEUE_CAPACITY  1024
+
+#ifdef THREAD_POOL_MUTEX
+#define QUEUE_NAME      "mutex"
+#else
+#define QUEUE_NAME      "lock-free"
+#endif
+
+static uint64_t *g_submitted;       /* per task: when its producer handed it over */
+static uint64_t *g_latency;         /* per task: how long until a worker ran it */
+static uint32_t  g_done;
+static uint32_t  g_go;
+
+typedef struct producer_s
+{
+    pthread_t      thread;
+    thread_pool_t *pool;
+    unsigned       first, count;
+    uint64_t       full;            /* submits refused because the queues were full */
+} producer_t;
+
+/* The task's fd is its index into the timestamp arrays. */
+static void run_task(int task)
+{
+    g_latency[task] = bench_now_ns() - g_submitted[task];
+    __atomic_add_fetch(&g_done, 1, __ATOMIC_RELEASE);
+}
+
+static void *producer_loop(void *arg)
+{
+    producer_t *p = arg;
+    while (!__atomic_load_n(&g_go, __ATOMIC_ACQUIRE)) sched_yield();
+
+    for (unsigned i = p->first; i < p->first + p->count; i++)
+    {
+        g_submitted[i] = bench_now_ns();
+        while (thread_pool_submit(p->pool, (int)i) != 0)
+        {
+            p->full++;
+            sched_yield();
+            g_submitted[i] = bench_now_ns();
+        }
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int run(unsigned producers, unsigned workers, tp_mode_t mode)
+{
+    g_submitted = calloc(TASKS, sizeof(uint64_t));
+    g_latency   = calloc(TASKS, sizeof(uint64_t));
+    producer_t *prod = calloc(producers, sizeof(producer_t));
+    if (g_submitted == NULL || g_latency == NULL || prod == NULL) return -1;
+
+    thread_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+    tp_config_t config = {
+        .min_workers     = workers,
+        .max_workers     = workers,
+        .idle_timeout_ms = TP_DEFAULT_IDLE_TIMEOUT_MS,
+        .queue_capacity  = QUEUE_CAPACITY,
+        .mode            = mode,
+        .cpu             = -1,
+    };
+    if (thread_pool_init(&pool, &config, run_task) != 0) return -1;
+
+    for (unsigned i = 0; i < producers; i++)
+    {
+        prod[i].pool  = &pool;
+        prod[i].first = TASKS / producers * i;
+        prod[i].count = (i + 1 == producers) ? TASKS - prod[i].first : TASKS / producers;
+        if (pthread_create(&prod[i].thread, NULL, producer_loop, &prod[i]) != 0) return -1;
+    }
+
+    uint64_t start = bench_now_ns();
+    __atomic_store_n(&g_go, 1, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&g_done, __ATOMIC_ACQUIRE) < TASKS) usleep(100);
+    uint64_t elapsed = bench_now_ns() - start;
+
+    uint64_t full = 0;
+    for (unsigned i = 0; i < producers; i++)
+    {
+        pthread_join(prod[i].thread, NULL);
+        full += prod[i].full;
+    }
+
+    qsort(g_latency, TASKS, sizeof(uint64_t), cmp_u64);
+    printf("%-9s %-8s %9u %7u %12.0f %9.1f %9.1f %9.1f %9.2f\n",
+           QUEUE_NAME, (mode == TP_STEALING) ? "stealing" : "shared", producers, workers,
+           (double)TASKS * 1e9 / (double)elapsed,
+           g_latency[TASKS / 2] / 1e3, g_latency[TASKS / 100 * 99] / 1e3,
+           g_latency[TASKS / 1000 * 999] / 1e3, (double)full / TASKS);
+    return 0;
+}
+
+/* One configuration per child: the parent's pool-free state is the baseline. */
+static int run_child(unsigned producers, unsigned workers, tp_mode_t mode)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0)
+    {
+        int rc = run(producers, workers, mode);
+        fflush(stdout);
+        _exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned counts[] = { 1, 2, 4, 8 };
+    const size_t ncounts = sizeof(counts) / sizeof(counts[0]);
+
+    printf("%u tasks per run, queue capacity %u, %ld CPUs online\n\n",
+           TASKS, QUEUE_CAPACITY, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-9s %-8s %9s %7s %12s %9s %9s %9s %9s\n", "queue", "mode", "producers", "workers",
+           "tasks/s", "p50 us", "p99 us", "p99.9 us", "full/task");
+
+    if (argc == 3)
+    {
+        unsigned producers = (unsigned)atoi(argv[1]), workers = (unsigned)atoi(argv[2]);
+        if (producers == 0 || workers == 0)
+        {
+            fprintf(stderr, "usage: %s [producers workers]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return (run(producers, workers, TP_SHARED) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for (size_t p = 0; p < ncounts; p++)
+        for (size_t w = 0; w < ncounts; w++)
+        {
+            if (run_child(counts[p], counts[w], TP_SHARED) != 0) goto failed;
+#ifndef THREAD_POOL_MUTEX
+            if (run_child(counts[p], counts[w], TP_STEALING) != 0) goto failed;
+#endif
+        }
+    return EXIT_SUCCESS;
+
+failed:
+    fprintf(stderr, "bench_pool: run failed\n");
+    return EXIT_FAILURE;
+}
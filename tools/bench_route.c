@@ -0,0 +1,161 @@
+/* Micro-benchmark of route lookup (src/route.c): resolves request targets
+   against resource tables of about 10, 100, 1k and 10k routes, once with
+   the linear two-pass scan http_validate_message() used to do and once
+   with the route index (hashed exact names, then the radix trie of
+   directory prefixes), for targets hitting an exact name and targets
+   under a directory prefix.
+
+   usage: bench_route */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/route.h"
+#include "bench.h"
+
+#define LOOKUPS     1024        /* targets per batch, cycled through */
+#define DIR_EVERY   10          /* one route in ten is a directory */
+
+typedef struct route_s
+{
+    char name[64];
+    int  is_directory;
+} route_t;
+
+typedef struct table_s
+{
+    route_t       *routes;
+    size_t         count;
+    route_index_t *index;
+    char         (*targets)[96];
+} table_t;
+
+/* The scan the index replaced: exact names first, then the first
+   directory that is a prefix ending at a component boundary. */
+static int32_t find_linear(const table_t *t, const char *target)
+{
+    for (size_t i = 0; i < t->count; i++)
+        if (!t->routes[i].is_directory && strcmp(target, t->routes[i].name) == 0)
+            return (int32_t)i;
+
+    for (size_t i = 0; i < t->count; i++)
+    {
+        if (!t->routes[i].is_directory) continue;
+        size_t len = strlen(t->routes[i].name);
+        if (strncmp(target, t->routes[i].name, len) == 0 && (target[len] == '\0' || target[len] == '/'))
+            return (int32_t)i;
+    }
+    return -1;
+}
+
+static int32_t find_index(const table_t *t, const char *target)
+{
+    int32_t id = route_find_exact(t->index, target);
+    return (id >= 0) ? id : route_find_prefix(t->index, target);
+}
+
+static uint64_t run_linear(void *arg)
+{
+    const table_t *t = arg;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < LOOKUPS; i++) acc += (uint64_t)find_linear(t, t->targets[i]);
+    return acc;
+}
+
+static uint64_t run_index(void *arg)
+{
+    const table_t *t = arg;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < LOOKUPS; i++) acc += (uint64_t)find_index(t, t->targets[i]);
+    return acc;
+}
+
+/* A table shaped like a real site: API endpoints and pages as exact names,
+   asset directories as prefixes, registered in shuffled order. */
+static int table_build(table_t *t, size_t count)
+{
+    t->count   = count;
+    t->routes  = calloc(count, sizeof(route_t));
+    t->targets = calloc(LOOKUPS, sizeof(*t->targets));
+    t->index   = route_index_create((unsigned int)count);
+    if (t->routes == NULL || t->targets == NULL || t->index == NULL) return -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        route_t *r = &t->routes[i];
+        r->is_directory = (i % DIR_EVERY == DIR_EVERY - 1);
+        if (r->is_directory) snprintf(r->name, sizeof(r->name), "static/assets-%zu", i);
+        else if (i % 3 == 0) snprintf(r->name, sizeof(r->name), "api/v1/resource-%zu/items", i);
+        else                 snprintf(r->name, sizeof(r->name), "pages/section-%zu.html", i);
+    }
+    for (size_t i = count - 1; i > 0; i--)
+    {
+        size_t  j   = (size_t)rand() % (i + 1);
+        route_t tmp = t->routes[i];
+        t->routes[i] = t->routes[j];
+        t->routes[j] = tmp;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int r = t->routes[i].is_directory ? route_add_prefix(t->index, t->routes[i].name, (int32_t)i)
+                                          : route_add_exact(t->index, t->routes[i].name, (int32_t)i);
+        if (r != 0) return -1;
+    }
+    return 0;
+}
+
+/* Fill the batch with hits of one kind, picked at random. */
+static void targets_fill(table_t *t, int directory)
+{
+    for (size_t i = 0; i < LOOKUPS; i++)
+    {
+        const route_t *r;
+        do r = &t->routes[(size_t)rand() % t->count]; while (r->is_directory != directory);
+
+        if (directory) snprintf(t->targets[i], sizeof(t->targets[i]), "%s/img/logo-%zu.png", r->name, i);
+        else           snprintf(t->targets[i], sizeof(t->targets[i]), "%s", r->name);
+    }
+}
+
+static void table_free(table_t *t)
+{
+    route_index_free(t->index);
+    free(t->routes);
+    free(t->targets);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 10, 100, 1000, 10000 };
+    srand(1);
+
+    printf("%7s  %-7s %14s %14s %9s\n", "routes", "hit", "linear ns", "index ns", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        table_t t;
+        memset(&t, 0, sizeof(t));
+        if (table_build(&t, sizes[s]) != 0)
+        {
+            fprintf(stderr, "bench_route: building %zu routes failed\n", sizes[s]);
+            return EXIT_FAILURE;
+        }
+
+        for (int directory = 0; directory <= 1; directory++)
+        {
+            targets_fill(&t, directory);
+            for (size_t i = 0; i < LOOKUPS; i++)
+                if (find_linear(&t, t.targets[i]) != find_index(&t, t.targets[i]))
+                {
+                    fprintf(stderr, "bench_route: lookups disagree on \"%s\"\n", t.targets[i]);
+                    return EXIT_FAILURE;
+                }
+
+            double linear = bench_time(run_linear, &t) / LOOKUPS;
+            double index  = bench_time(run_index,  &t) / LOOKUPS;
+            printf("%7zu  %-7s %14.1f %14.1f %8.1fx\n", sizes[s], directory ? "prefix" : "exact",
+                   linear, index, linear / index);
+        }
+        table_free(&t);
+    }
+    return EXIT_SUCCESS;
+}
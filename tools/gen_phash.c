@@ -0,0 +1,123 @@
+/* Build-time generator: turns the HTTP_HEADERS, HTTP_METHODS and
+   MIME_EXTENSIONS lists of include/http.h into collision-free hash tables
+   (see include/phash.h) and prints them as a C header on stdout. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/http.h"
+#include "../include/phash.h"
+
+#define MAX_SEEDS   1000000
+#define MAX_SLOTS   4096
+
+typedef struct entry_s
+{
+    const char *key;
+    const char *value;      /* emitted verbatim: an enum constant */
+} entry_t;
+
+#define X(id, name) { name, #id },
+static const entry_t headers[] = { HTTP_HEADERS };
+#undef X
+
+#define X(method) { #method, #method },
+static const entry_t methods[] = { HTTP_METHODS };
+#undef X
+
+#define X(ext, type) { ext, #type },
+static const entry_t extensions[] = { MIME_EXTENSIONS };
+#undef X
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Fill slots[] (entry index per slot, -1 if empty); 0 on a collision. */
+static int place(const entry_t *e, size_t n, uint32_t size, uint32_t seed, int *slots)
+{
+    for (uint32_t i = 0; i < size; i++) slots[i] = -1;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t s = phash(e[i].key, strlen(e[i].key), seed) & (size - 1);
+        if (slots[s] >= 0) return 0;
+        slots[s] = (int)i;
+    }
+    return 1;
+}
+
+/* `folded`: keys must already be lowercase, lookups fold their input. */
+static int emit(const char *name, const char *prefix, const entry_t *e, size_t n, int folded)
+{
+    static int slots[MAX_SLOTS];
+    size_t maxlen = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t len = strlen(e[i].key);
+        if (len == 0 || len > 255)
+        {
+            fprintf(stderr, "gen_phash: bad %s key \"%s\"\n", name, e[i].key);
+            return -1;
+        }
+        if (len > maxlen) maxlen = len;
+
+        for (size_t k = 0; folded && k < len; k++)
+        {
+            if (e[i].key[k] >= 'A' && e[i].key[k] <= 'Z')
+            {
+                fprintf(stderr, "gen_phash: %s key \"%s\" must be lowercase\n", name, e[i].key);
+                return -1;
+            }
+        }
+
+        for (size_t j = 0; j < i; j++)
+        {
+            if (strcmp(e[i].key, e[j].key) == 0)
+            {
+                fprintf(stderr, "gen_phash: duplicate %s key \"%s\"\n", name, e[i].key);
+                return -1;
+            }
+        }
+    }
+
+    /* Smallest power of two at least twice the key count that some seed
+       makes collision-free. */
+    uint32_t size = 2;
+    while (size < 2 * n) size <<= 1;
+
+    for (; size <= MAX_SLOTS; size <<= 1)
+    {
+        for (uint32_t seed = 0; seed < MAX_SEEDS; seed++)
+        {
+            if (!place(e, n, size, seed, slots)) continue;
+
+            printf("#define PHASH_%s_SEED   0x%08xu\n", prefix, seed);
+            printf("#define PHASH_%s_MASK   %uu\n", prefix, size - 1);
+            printf("#define PHASH_%s_MAXLEN %zu\n\n", prefix, maxlen);
+            printf("static const phash_slot_t phash_%s[%u] =\n{\n", name, size);
+            for (uint32_t s = 0; s < size; s++)
+            {
+                if (slots[s] < 0) continue;
+                const entry_t *x = &e[slots[s]];
+                printf("    [%4u] = { \"%s\", %zu, %s },\n", s, x->key, strlen(x->key), x->value);
+            }
+            printf("};\n\n");
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "gen_phash: no perfect hash found for %s\n", name);
+    return -1;
+}
+
+int main(void)
+{
+    printf("/* Generated by tools/gen_phash.c from include/http.h. Do not edit. */\n");
+    printf("#ifndef HTTP_PHASH_H\n#define HTTP_PHASH_H\n\n");
+
+    if (emit("header",    "HEADER",    headers,    COUNT(headers),    1) != 0) return 1;
+    if (emit("method",    "METHOD",    methods,    COUNT(methods),    0) != 0) return 1;
+    if (emit("extension", "EXTENSION", extensions, COUNT(extensions), 0) != 0) return 1;
+
+    printf("#endif // HTTP_PHASH_H\n");
+    return 0;
+}
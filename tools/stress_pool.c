@@ -0,0 +1,180 @@
+/* Stress test of the worker pool (src/thread_pool.c): producer threads
+   submit bursts of numbered tasks into a small queue, some of which
+   requeue a follow-up from inside the worker, and then go quiet long
+   enough for the idle workers to park, time out and retire before the
+   next burst makes the pool grow again. Every task and follow-up must
+   run exactly once, and a burst must never stop making progress for half
+   the idle timeout: a parked worker rescues itself when that runs out,
+   so a lost wake-up shows as a stall rather than a hang. `make stress` runs it against the
+   lock-free queues in TP_SHARED and TP_STEALING mode and against the
+   -DTHREAD_POOL_MUTEX build.
+
+   usage: stress_pool */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/thread_pool.h"
+#include "bench.h"
+
+#define PRODUCERS       4
+#define ROUNDS          6
+#define BURST           20000u      /* tasks per round, split between producers */
+#define TASKS           (ROUNDS * BURST)
+#define FOLLOW_EVERY    4           /* every 4th task requeues a follow-up */
+#define SLOW_EVERY      512         /* ... and every 512th sleeps, so the queue backs up */
+#define IDLE_MS         100
+#define STALL_NS        (IDLE_MS / 2 * 1000000ull)  /* no task finished for this long: stuck */
+
+static thread_pool_t g_pool;
+static uint8_t      *g_runs;        /* per task, then per follow-up: times it ran */
+static uint32_t      g_done;
+static uint32_t      g_go;
+
+typedef struct producer_s
+{
+    pthread_t thread;
+    unsigned  first, count;
+} producer_t;
+
+static void run_followup(int id)
+{
+    __atomic_add_fetch(&g_runs[TASKS + (unsigned)id], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_done, 1, __ATOMIC_RELEASE);
+}
+
+static void run_task(int id)
+{
+    __atomic_add_fetch(&g_runs[id], 1, __ATOMIC_RELAXED);
+    if (id % SLOW_EVERY == 0) usleep(200);
+
+    if (id % FOLLOW_EVERY == 0)
+    {
+        /* As handle_client() does: with every queue full, run it here. */
+        tp_task_t next = { run_followup, id };
+        if (thread_pool_requeue(&g_pool, next) != 0) run_followup(id);
+    }
+    __atomic_add_fetch(&g_done, 1, __ATOMIC_RELEASE);
+}
+
+static void *producer_loop(void *arg)
+{
+    producer_t *p = arg;
+    unsigned round = 0;
+
+    for (;;)
+    {
+        while (__atomic_load_n(&g_go, __ATOMIC_ACQUIRE) == round) sched_yield();
+        if (++round > ROUNDS) return NULL;
+
+        unsigned base = (round - 1) * BURST;
+        for (unsigned i = p->first; i < p->first + p->count; i++)
+            while (thread_pool_submit(&g_pool, (int)(base + i)) != 0) sched_yield();
+    }
+}
+
+static int run(tp_mode_t mode, const char *name)
+{
+    tp_config_t config = {
+        .min_workers     = 2,
+        .max_workers     = 16,
+        .idle_timeout_ms = IDLE_MS,
+        .queue_capacity  = 64,
+        .mode            = mode,
+        .cpu             = -1,
+    };
+    if (thread_pool_init(&g_pool, &config, run_task) != 0) return -1;
+
+    producer_t prod[PRODUCERS];
+    for (unsigned i = 0; i < PRODUCERS; i++)
+    {
+        prod[i].first = BURST / PRODUCERS * i;
+        prod[i].count = (i + 1 == PRODUCERS) ? BURST - prod[i].first : BURST / PRODUCERS;
+        if (pthread_create(&prod[i].thread, NULL, producer_loop, &prod[i]) != 0) return -1;
+    }
+
+    int failed = 0;
+    for (unsigned round = 1; round <= ROUNDS && !failed; round++)
+    {
+        uint32_t expect = round * (BURST + BURST / FOLLOW_EVERY);
+        __atomic_store_n(&g_go, round, __ATOMIC_RELEASE);
+
+        uint64_t progress_ns = bench_now_ns();
+        uint32_t done, seen = 0;
+        while ((done = __atomic_load_n(&g_done, __ATOMIC_ACQUIRE)) < expect)
+        {
+            uint64_t now = bench_now_ns();
+            if (done != seen)
+            {
+                seen        = done;
+                progress_ns = now;
+            }
+            else if (now - progress_ns > STALL_NS)
+            {
+                fprintf(stderr, "%s: round %u stalled at %u of %u tasks\n", name, round, done, expect);
+                failed = 1;
+                break;
+            }
+            usleep(1000);
+        }
+
+        /* Long enough for the extra workers to park, time out and retire. */
+        usleep(IDLE_MS * 5 * 1000);
+    }
+    if (failed) return -1;
+
+    __atomic_store_n(&g_go, ROUNDS + 1, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < PRODUCERS; i++)
+        pthread_join(prod[i].thread, NULL);
+
+    for (unsigned i = 0; i < TASKS; i++)
+    {
+        unsigned follow = (i % FOLLOW_EVERY == 0);
+        if (g_runs[i] != 1 || g_runs[TASKS + i] != follow)
+        {
+            fprintf(stderr, "%s: task %u ran %u times, its follow-up %u (expected 1 and %u)\n",
+                    name, i, g_runs[i], g_runs[TASKS + i], follow);
+            return -1;
+        }
+    }
+
+    tp_stats_t stats;
+    thread_pool_get_stats(&g_pool, &stats);
+    printf("%-20s ok: %u tasks, %u follow-ups, workers spawned %llu retired %llu, %zu running\n",
+           name, TASKS, TASKS / FOLLOW_EVERY,
+           (unsigned long long)stats.spawned, (unsigned long long)stats.retired, stats.workers);
+    return 0;
+}
+
+/* The pool has no teardown, so each mode gets a fresh process. */
+static int run_child(tp_mode_t mode, const char *name)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0)
+    {
+        g_runs = calloc(2, TASKS);
+        int rc = (g_runs != NULL) ? run(mode, name) : -1;
+        fflush(stdout);
+        _exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+    return 0;
+}
+
+int main(void)
+{
+#ifdef THREAD_POOL_MUTEX
+    if (run_child(TP_SHARED, "mutex") != 0) return EXIT_FAILURE;
+#else
+    if (run_child(TP_SHARED, "lock-free shared") != 0)     return EXIT_FAILURE;
+    if (run_child(TP_STEALING, "lock-free stealing") != 0) return EXIT_FAILURE;
+#endif
+    return EXIT_SUCCESS;
+}